@@ -4,10 +4,17 @@
 #include <numeric>
 #include <algorithm>
 #include <iomanip>
+#include <chrono>
+#include <functional>
+#include <cfloat>
+#include <climits>
+#include <array>
+#include <thread>
 
 #include "logger.hpp"
 #include "creator.hpp"
 #include "utils.hpp"
+#include "clipper.hpp"
 
 struct StatsNode{
     common::task_type       task;
@@ -23,6 +30,16 @@ struct StatsNode{
     double                  avgTotal;
     double                  p90Total;
     double                  p99Total;
+    double                  avgPostArea;
+};
+
+struct KernelStats{
+    std::string             name;
+    int                     iters;
+    double                  avgBaseline;
+    double                  avgOptimized;
+    double                  maxDiff;
+    double                  tolerance;
 };
 
 static double mean(const std::vector<double>& v) {
@@ -71,7 +88,8 @@ void statsShow(const StatsNode& stats){
     std::cout << "Preprocess            : " << stats.avgPre << " ms\n";
     std::cout << "Inference             : " << stats.avgInfer << " ms\n";
     std::cout << "Postprocess           : " << stats.avgPost << " ms\n";
-    std::cout << "Total                 : " << stats.avgTotal << " ms\n\n";
+    std::cout << "Total                 : " << stats.avgTotal << " ms\n";
+    std::cout << "Det postprocess area  : " << stats.avgPostArea * 100 << " %\n\n";
 
     std::cout << "[P90]\n";
     std::cout << "Total                 : " << stats.p90Total << " ms\n";
@@ -85,7 +103,7 @@ void statsShow(const StatsNode& stats){
 void exportCSV(const common::task_type task, const std::vector<StatsNode>& statsTab) {
     std::string filename = "output/benchmark/" + task2str(task) + ".csv";
     std::ofstream ofs(filename);
-    ofs << "Filename,Infer-Backend,Intra-Thread,Inter-Thread,AvgPre(ms),AvgInfer(ms),AvgPost(ms),AvgTotal(ms),P90Total(ms),P99total(ms)\n";
+    ofs << "Filename,Infer-Backend,Intra-Thread,Inter-Thread,AvgPre(ms),AvgInfer(ms),AvgPost(ms),AvgTotal(ms),P90Total(ms),P99total(ms),PostArea(%)\n";
     for (size_t i = 0; i < statsTab.size(); ++i) {
         ofs << std::left << std::setw(20) << statsTab[i].filename << ","
         << std::setw(12) << backend2str(statsTab[i].inferBackend) << ","
@@ -96,42 +114,1190 @@ void exportCSV(const common::task_type task, const std::vector<StatsNode>& stats
         << std::setw(12) << statsTab[i].avgPost << ","
         << std::setw(12) << statsTab[i].avgTotal << ","
         << std::setw(12) << statsTab[i].p90Total << ","
-        << std::setw(12) << statsTab[i].p99Total
+        << std::setw(12) << statsTab[i].p99Total << ","
+        << std::setw(12) << statsTab[i].avgPostArea * 100
         << "\n";
     }
     ofs.close();
 }
 
-std::shared_ptr<StatsNode> benchmark(const std::string imagePath, int intraThnum, int interThnum, common::task_type task) {
-    const int warmup_iters = 10;
-    const int bench_iters  = 100;
-    const auto log_level = logger::Level::ERROR;
-    std::shared_ptr<StatsNode> stats = std::make_shared<StatsNode>();
+static double timeKernel(int iters, const std::function<void()>& fn) {
+    fn();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iters; ++i) {
+        fn();
+    }
+    std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+    return time.count() / iters;
+}
 
+// demo models on ORT CPU, a row sets only the fields it compares
+static model::ModelParams detParams() {
     model::ModelParams det;
     det.task                = common::task_type::DETECTION;
     det.inferBackend        = common::infer_backend::ORT_CPU;
     det.saveImg             = false;
     det.onnxPath            = "models/PP-OCRv5_mobile_det_infer/inference.onnx";
     det.inferYaml           = "models/PP-OCRv5_mobile_det_infer/inference.yml";
-    det.intraThreadnum      = intraThnum;
-    det.interThreadnum      = interThnum;
+    return det;
+}
 
+static model::ModelParams angleParams() {
     model::ModelParams angle;
     angle.task              = common::task_type::ANGLECLS;
     angle.inferBackend      = common::infer_backend::ORT_CPU;
     angle.saveImg           = false;
     angle.onnxPath          = "models/PP-LCNet_x1_0_textline_ori_infer/inference.onnx";
     angle.inferYaml         = "models/PP-LCNet_x1_0_textline_ori_infer/inference.yml";
-    angle.intraThreadnum    = intraThnum;
-    angle.interThreadnum    = interThnum;
+    return angle;
+}
 
+static model::ModelParams recParams() {
     model::ModelParams rec;
     rec.task                = common::task_type::RECOGNIZE;
     rec.inferBackend        = common::infer_backend::ORT_CPU;
     rec.saveImg             = false;
     rec.onnxPath            = "models/PP-OCRv5_mobile_rec_infer/inference.onnx";
     rec.inferYaml           = "models/PP-OCRv5_mobile_rec_infer/inference.yml";
+    return rec;
+}
+
+// Fraction of lines read differently between two runs over the same page, a
+// changed line count counts every line. A non-empty counted mask limits the
+// comparison to the marked lines.
+template <typename T>
+static double lineDiffRatio(const std::vector<T>& a, const std::vector<T>& b,
+                            const std::vector<char>& counted = std::vector<char>()) {
+    size_t differ = 0;
+    if (a.size() != b.size()) {
+        differ = std::max(a.size(), b.size());
+    } else {
+        for (size_t i = 0; i < a.size(); ++i) {
+            if ((counted.empty() || counted[i]) && a[i] != b[i]) differ++;
+        }
+    }
+    return static_cast<double>(differ) / std::max<size_t>(1, a.size());
+}
+
+void kernelShow(const KernelStats& stats){
+    std::cout << "=========================== Kernel Benchmark ===========================\n";
+    std::cout << "Kernel                : " << stats.name << "\n";
+    std::cout << "Bench iters           : " << stats.iters << "\n";
+    std::cout << "Baseline              : " << stats.avgBaseline << " ms\n";
+    std::cout << "Optimized             : " << stats.avgOptimized << " ms\n";
+    std::cout << "Speedup               : " << stats.avgBaseline / stats.avgOptimized << "x\n";
+    std::cout << "Max diff              : " << stats.maxDiff << "\n";
+    std::cout << "Golden check          : " << (stats.maxDiff <= stats.tolerance ? "PASS" : "FAIL") << "\n";
+    std::cout << "=======================================================================\n";
+}
+
+void exportKernelCSV(const std::vector<KernelStats>& statsTab) {
+    std::ofstream ofs("output/benchmark/Kernels.csv");
+    ofs << "Kernel,Iters,Baseline(ms),Optimized(ms),Speedup,MaxDiff,Golden\n";
+    for (size_t i = 0; i < statsTab.size(); ++i) {
+        ofs << std::left << std::setw(24) << statsTab[i].name << ","
+        << std::setw(8) << statsTab[i].iters << ","
+        << std::setw(12) << statsTab[i].avgBaseline << ","
+        << std::setw(12) << statsTab[i].avgOptimized << ","
+        << std::setw(12) << statsTab[i].avgBaseline / statsTab[i].avgOptimized << ","
+        << std::setw(12) << statsTab[i].maxDiff << ","
+        << std::setw(8) << (statsTab[i].maxDiff <= statsTab[i].tolerance ? "PASS" : "FAIL")
+        << "\n";
+    }
+    ofs.close();
+}
+
+// threshold + convertTo (two passes, float temp) vs fused binarizeMap
+KernelStats benchBinarize() {
+    const int iters = 200;
+    cv::Mat prob(960, 960, CV_32FC1);
+    cv::randu(prob, 0.f, 1.f);
+
+    cv::Mat ref, bitmap;
+    KernelStats stats;
+    stats.name          = "DetBinarize";
+    stats.iters         = iters;
+    stats.avgBaseline   = timeKernel(iters, [&]() {
+        cv::threshold(prob, ref, 0.3f, 255, cv::THRESH_BINARY);
+        ref.convertTo(ref, CV_8UC1);
+    });
+    stats.avgOptimized  = timeKernel(iters, [&]() {
+        binarizeMap(prob, bitmap, 0.3f);
+    });
+    stats.maxDiff       = cv::norm(ref, bitmap, cv::NORM_INF);
+    stats.tolerance     = 0.0;
+    return stats;
+}
+
+// reference box scorer: fillPoly mask + masked mean, the former getScoreFast
+static float scoreFastRef(const cv::Mat &bitmap, const std::vector<cv::Point2f> &contour) {
+    int h = bitmap.rows;
+    int w = bitmap.cols;
+
+    float xmin_f = contour[0].x, xmax_f = contour[0].x;
+    float ymin_f = contour[0].y, ymax_f = contour[0].y;
+    for (const auto &pt : contour) {
+        xmin_f = std::min(xmin_f, pt.x);
+        xmax_f = std::max(xmax_f, pt.x);
+        ymin_f = std::min(ymin_f, pt.y);
+        ymax_f = std::max(ymax_f, pt.y);
+    }
+
+    int xmin = std::max(0, static_cast<int>(std::floor(xmin_f)));
+    int xmax = std::min(w - 1, static_cast<int>(std::ceil(xmax_f)));
+    int ymin = std::max(0, static_cast<int>(std::floor(ymin_f)));
+    int ymax = std::min(h - 1, static_cast<int>(std::ceil(ymax_f)));
+    if (xmax <= xmin || ymax <= ymin) return 0.0f;
+
+    cv::Mat mask = cv::Mat::zeros(ymax - ymin + 1, xmax - xmin + 1, CV_8UC1);
+    std::vector<cv::Point> contour_int;
+    for (const auto &pt : contour) {
+        contour_int.emplace_back(cvRound(pt.x - xmin), cvRound(pt.y - ymin));
+    }
+    cv::fillPoly(mask, std::vector<std::vector<cv::Point>>{contour_int}, cv::Scalar(1));
+    cv::Mat roi = bitmap(cv::Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1));
+    return static_cast<float>(cv::mean(roi, mask)[0]);
+}
+
+// dense page: 1000 rotated candidates (m_maxCandidates) on a 960x960 map
+KernelStats benchScoreFast() {
+    const int iters = 20;
+    cv::Mat prob(960, 960, CV_32FC1);
+    cv::randu(prob, 0.f, 1.f);
+
+    cv::RNG rng(0x5eed);
+    std::vector<std::vector<cv::Point2f>> boxes(1000, std::vector<cv::Point2f>(4));
+    for (auto& box : boxes) {
+        cv::RotatedRect rect(cv::Point2f(rng.uniform(-10.f, 970.f), rng.uniform(-10.f, 970.f)),
+                             cv::Size2f(rng.uniform(3.f, 400.f), rng.uniform(3.f, 48.f)),
+                             rng.uniform(-90.f, 90.f));
+        rect.points(box.data());
+    }
+
+    std::vector<float> ref(boxes.size()), opt(boxes.size());
+    KernelStats stats;
+    stats.name          = "DetScoreFast";
+    stats.iters         = iters;
+    stats.avgBaseline   = timeKernel(iters, [&]() {
+        for (size_t i = 0; i < boxes.size(); ++i) ref[i] = scoreFastRef(prob, boxes[i]);
+    });
+    stats.avgOptimized  = timeKernel(iters, [&]() {
+        for (size_t i = 0; i < boxes.size(); ++i) opt[i] = polygonMeanScore(prob, boxes[i].data(), 4);
+    });
+    stats.maxDiff       = 0.0;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        stats.maxDiff = std::max(stats.maxDiff, (double)std::fabs(ref[i] - opt[i]));
+    }
+    stats.tolerance     = 1e-5;
+    return stats;
+}
+
+// reference unclip: ClipperOffset with round joins, the former Detectioner::unClip
+static std::vector<cv::Point2f> unclipRef(const std::vector<cv::Point2f> &box, float unClipRatio) {
+    std::vector<cv::Point2f> result;
+    float area = cv::contourArea(box);
+    float length = cv::arcLength(box, true);
+    float distance = area * unClipRatio / length;
+
+    ClipperLib::Path path;
+    for (const auto &point : box) {
+        path << ClipperLib::IntPoint(point.x, point.y);
+    }
+
+    ClipperLib::ClipperOffset co;
+    co.AddPath(path, ClipperLib::jtRound, ClipperLib::etClosedPolygon);
+
+    ClipperLib::Paths solution;
+    co.Execute(solution, distance);
+    if (solution.empty()) {
+        return result;
+    }
+    for (const auto &p : solution[0]) {
+        result.emplace_back(p.X, p.Y);
+    }
+    return result;
+}
+
+// largest corner distance between two rectangles, in map pixels
+static double cornerDist(const cv::RotatedRect& a, const cv::RotatedRect& b) {
+    cv::Point2f pa[4], pb[4];
+    a.points(pa);
+    b.points(pb);
+    double dist = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        double best = DBL_MAX;
+        for (int j = 0; j < 4; ++j) {
+            best = std::min(best, (double)cv::norm(pa[i] - pb[j]));
+        }
+        dist = std::max(dist, best);
+    }
+    return dist;
+}
+
+// text line sized boxes, diff is the corner distance of the final min area rects.
+// Clipper rounds the input corners and the offset edges to integers, up to ~2px apart.
+KernelStats benchUnclip() {
+    const int iters = 20;
+    const float ratio = 1.5f;
+
+    cv::RNG rng(0x5eed);
+    std::vector<std::vector<cv::Point2f>> boxes(1000, std::vector<cv::Point2f>(4));
+    for (auto& box : boxes) {
+        cv::RotatedRect rect(cv::Point2f(rng.uniform(0.f, 960.f), rng.uniform(0.f, 960.f)),
+                             cv::Size2f(rng.uniform(3.f, 400.f), rng.uniform(3.f, 48.f)),
+                             rng.uniform(-90.f, 90.f));
+        rect.points(box.data());
+    }
+
+    std::vector<cv::RotatedRect> ref(boxes.size()), opt(boxes.size());
+    KernelStats stats;
+    stats.name          = "DetUnclip";
+    stats.iters         = iters;
+    stats.avgBaseline   = timeKernel(iters, [&]() {
+        for (size_t i = 0; i < boxes.size(); ++i) ref[i] = cv::minAreaRect(unclipRef(boxes[i], ratio));
+    });
+    stats.avgOptimized  = timeKernel(iters, [&]() {
+        std::vector<cv::Point2f> out(4);
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            unclipRect(boxes[i].data(), ratio, out.data());
+            opt[i] = cv::minAreaRect(out);
+        }
+    });
+    stats.maxDiff       = 0.0;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        stats.maxDiff = std::max(stats.maxDiff, cornerDist(ref[i], opt[i]));
+    }
+    stats.tolerance     = 3.0;
+    return stats;
+}
+
+static double boxIoU(const std::vector<cv::Point2f>& a, const std::vector<cv::Point2f>& b) {
+    std::vector<cv::Point2f> inter;
+    double inter_area = cv::intersectConvexConvex(a, b, inter, true);
+    double union_area = cv::contourArea(a) + cv::contourArea(b) - inter_area;
+    return union_area > 0.0 ? inter_area / union_area : 0.0;
+}
+
+// end to end on the demo images: det postprocess time with Clipper vs closed-form
+// unclip, diff is 1 - IoU of the worst matched box pair
+KernelStats benchUnclipDemo() {
+    const int iters = 20;
+    const std::vector<std::string> images = {
+        "data/images/general_ocr_0.png", "data/images/general_ocr_90.png",
+        "data/images/general_ocr_180.png", "data/images/general_ocr_270.png"};
+
+    model::ModelParams det = detParams();
+
+    double post_time[2] = {0.0, 0.0};
+    std::vector<std::vector<std::vector<cv::Point2f>>> boxes[2];
+    for (int fast = 0; fast < 2; ++fast) {
+        det.fastUnclip = (fast != 0);
+        std::vector<model::ModelParams> params = {det};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        for (const auto& image : images) {
+            boxes[fast].push_back(creator->inference(image)->decBoxes);
+            for (int i = 0; i < iters; ++i) {
+                post_time[fast] += creator->inference(image)->postTime;
+            }
+        }
+    }
+
+    double min_iou = 1.0;
+    for (size_t k = 0; k < images.size(); ++k) {
+        const auto& ref = boxes[0][k];
+        const auto& opt = boxes[1][k];
+        if (ref.size() != opt.size()) min_iou = 0.0;
+        for (const auto& r : ref) {
+            double best = 0.0;
+            for (const auto& o : opt) best = std::max(best, boxIoU(r, o));
+            min_iou = std::min(min_iou, best);
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "DetUnclipDemo";
+    stats.iters         = iters;
+    stats.avgBaseline   = post_time[0] / (iters * images.size());
+    stats.avgOptimized  = post_time[1] / (iters * images.size());
+    stats.maxDiff       = 1.0 - min_iou;
+    stats.tolerance     = 0.1;
+    return stats;
+}
+
+// noisy scan: 40 text lines among 20000 specks, the former full sort by contourArea
+// vs selectContours. Diff compares the areas of the boxes that can pass m_minSide.
+KernelStats benchCandidates() {
+    const int iters = 20;
+    const int max_candidates = 1000;
+    const float min_side = 3.f;
+
+    cv::Mat bitmap = cv::Mat::zeros(960, 960, CV_8UC1);
+    cv::RNG rng(0x5eed);
+    for (int i = 0; i < 40; ++i) {
+        cv::rectangle(bitmap, cv::Rect(rng.uniform(0, 600), i * 24, rng.uniform(40, 360), 12), cv::Scalar(255), cv::FILLED);
+    }
+    for (int i = 0; i < 20000; ++i) {
+        bitmap.at<uchar>(rng.uniform(0, 960), rng.uniform(0, 960)) = 255;
+    }
+    std::vector<std::vector<cv::Point>> contours_i;
+    cv::findContours(bitmap, contours_i, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+
+    std::vector<std::vector<cv::Point2f>> ref, opt;
+    KernelStats stats;
+    stats.name          = "DetCandidates";
+    stats.iters         = iters;
+    stats.avgBaseline   = timeKernel(iters, [&]() {
+        ref.clear();
+        for (auto& c : contours_i) {
+            std::vector<cv::Point2f> cf;
+            for (auto& p : c) cf.emplace_back(p.x, p.y);
+            ref.push_back(cf);
+        }
+        std::sort(ref.begin(), ref.end(),
+                  [](const std::vector<cv::Point2f>& a, const std::vector<cv::Point2f>& b) {
+                      return cv::contourArea(a) > cv::contourArea(b);
+                  });
+        if ((int)ref.size() > max_candidates) ref.resize(max_candidates);
+    });
+    stats.avgOptimized  = timeKernel(iters, [&]() {
+        selectContours(contours_i, max_candidates, min_side, opt);
+    });
+
+    auto passing = [&](const std::vector<std::vector<cv::Point2f>>& cs) {
+        std::vector<double> areas;
+        for (auto& c : cs) {
+            cv::RotatedRect r = cv::minAreaRect(c);
+            if (std::min(r.size.width, r.size.height) >= min_side) areas.push_back(cv::contourArea(c));
+        }
+        return areas;
+    };
+    std::vector<double> ref_areas = passing(ref), opt_areas = passing(opt);
+    stats.maxDiff       = ref_areas.size() == opt_areas.size() ? 0.0 : DBL_MAX;
+    for (size_t i = 0; i < std::min(ref_areas.size(), opt_areas.size()); ++i) {
+        stats.maxDiff = std::max(stats.maxDiff, std::fabs(ref_areas[i] - opt_areas[i]));
+    }
+    stats.tolerance     = 0.0;
+    return stats;
+}
+
+// per image det time of N sequential runs vs one {N, 3, H, W} run,
+// diff is 1 - IoU of the worst matched box pair
+KernelStats benchDetBatch(int intraThnum) {
+    const int iters = 10;
+    const std::vector<std::string> images = {
+        "data/images/general_ocr_0.png", "data/images/general_ocr_90.png",
+        "data/images/general_ocr_180.png", "data/images/general_ocr_270.png",
+        "data/images/test.png", "data/images/general_ocr_0.png",
+        "data/images/general_ocr_90.png", "data/images/general_ocr_180.png"};
+
+    model::ModelParams det = detParams();
+    det.intraThreadnum      = intraThnum;
+    det.postThreadnum       = intraThnum;
+    det.detBatch            = static_cast<int>(images.size());
+    std::vector<model::ModelParams> params = {det};
+    auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+
+    std::vector<std::shared_ptr<model::InferResult>> ref(images.size()), opt;
+    auto total = [](const model::InferResult& r) { return r.preTime + r.inferTime + r.postTime; };
+
+    double seq_time = 0.0, batch_time = 0.0;
+    for (int it = 0; it <= iters; ++it) {
+        double seq = 0.0, batch = 0.0;
+        for (size_t i = 0; i < images.size(); ++i) {
+            ref[i] = creator->inference(images[i]);
+            seq += total(*ref[i]);
+        }
+        opt = creator->inference(images);
+        for (auto& r : opt) batch += total(*r);
+        // first round is warmup
+        if (it > 0) {
+            seq_time   += seq;
+            batch_time += batch;
+        }
+    }
+
+    double min_iou = 1.0;
+    for (size_t k = 0; k < images.size(); ++k) {
+        if (ref[k]->decBoxes.size() != opt[k]->decBoxes.size()) min_iou = 0.0;
+        for (const auto& r : ref[k]->decBoxes) {
+            double best = 0.0;
+            for (const auto& o : opt[k]->decBoxes) best = std::max(best, boxIoU(r, o));
+            min_iou = std::min(min_iou, best);
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "DetBatch" + std::to_string(images.size()) + "-T" + std::to_string(intraThnum);
+    stats.iters         = iters;
+    stats.avgBaseline   = seq_time / (iters * images.size());
+    stats.avgOptimized  = batch_time / (iters * images.size());
+    stats.maxDiff       = 1.0 - min_iou;
+    stats.tolerance     = 0.01;
+    return stats;
+}
+
+// 24 label / ID card sized crops of the demo pages, letterboxed one per input vs
+// packed into shared canvases. Times are per image, diff is the relative change
+// of the total box count since packed images run at native scale.
+KernelStats benchDetPack() {
+    const int iters = 10;
+    const std::vector<cv::Size> sizes = {{300, 100}, {400, 250}, {320, 200}, {240, 80}};
+
+    cv::Mat page = cv::imread("data/images/general_ocr_0.png");
+    cv::RNG rng(0x5eed);
+    std::vector<std::string> images;
+    for (int i = 0; i < 24; ++i) {
+        cv::Size s = sizes[i % sizes.size()];
+        s.width  = std::min(s.width, page.cols);
+        s.height = std::min(s.height, page.rows);
+        cv::Rect r(rng.uniform(0, page.cols - s.width + 1), rng.uniform(0, page.rows - s.height + 1), s.width, s.height);
+        std::string path = "output/benchmark/small_" + std::to_string(i) + ".png";
+        cv::imwrite(path, page(r));
+        images.push_back(path);
+    }
+
+    model::ModelParams det = detParams();
+
+    double ms_per_image[2] = {0.0, 0.0};
+    size_t box_count[2] = {0, 0};
+    for (int pack = 0; pack < 2; ++pack) {
+        det.detPack = (pack != 0);
+        std::vector<model::ModelParams> params = {det};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        for (auto& r : creator->inference(images)) {
+            box_count[pack] += r->decBoxes.size();
+        }
+        ms_per_image[pack] = timeKernel(iters, [&]() { creator->inference(images); }) / images.size();
+        std::cout << "DetPack " << (pack ? "packed" : "single") << " images/sec : "
+                  << 1000.0 / ms_per_image[pack] << "\n";
+    }
+
+    KernelStats stats;
+    stats.name          = "DetPack";
+    stats.iters         = iters;
+    stats.avgBaseline   = ms_per_image[0];
+    stats.avgOptimized  = ms_per_image[1];
+    stats.maxDiff       = std::fabs((double)box_count[1] - box_count[0]) / std::max<size_t>(1, box_count[0]);
+    stats.tolerance     = 0.1;
+    return stats;
+}
+
+// OCR pre + post time per page with materialized crops vs quads sampled straight
+// into the cls/rec tensors, diff is the fraction of lines recognized differently
+KernelStats benchFusedCrop() {
+    const int iters = 10;
+    const std::string image = "data/images/general_ocr_0.png";
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+    model::ModelParams rec = recParams();
+
+    double cpu_time[2] = {0.0, 0.0};
+    std::vector<std::string> texts[2];
+    for (int fused = 0; fused < 2; ++fused) {
+        det.fusedCrop = (fused != 0);
+        std::vector<model::ModelParams> params = {det, angle, rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        texts[fused] = creator->inference(image)->regRets;
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            cpu_time[fused] += rets->preTime + rets->postTime;
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "OcrFusedCrop";
+    stats.iters         = iters;
+    stats.avgBaseline   = cpu_time[0] / iters;
+    stats.avgOptimized  = cpu_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(texts[0], texts[1]);
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Recognizer time per page with every line in its own run vs lines batched in
+// width buckets, diff is the fraction of lines recognized differently
+KernelStats benchRecBatch() {
+    const int iters = 10;
+    const std::string image = "data/images/general_ocr_0.png";
+
+    model::ModelParams det = detParams();
+    model::ModelParams rec = recParams();
+
+    // det alone gives the time to take off the full pipeline
+    std::vector<model::ModelParams> det_only = {det};
+    auto det_creator = ocrcreator::createCreator(det_only, logger::Level::ERROR);
+    det_creator->inference(image);
+    double det_time = 0.0;
+    for (int i = 0; i < iters; ++i) {
+        auto rets = det_creator->inference(image);
+        det_time += rets->preTime + rets->inferTime + rets->postTime;
+    }
+
+    const int batch_size[2] = {1, 8};
+    double rec_time[2] = {0.0, 0.0};
+    std::vector<std::string> texts[2];
+    for (int b = 0; b < 2; ++b) {
+        rec.recBatchSize = batch_size[b];
+        std::vector<model::ModelParams> params = {det, rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        texts[b] = creator->inference(image)->regRets;
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            rec_time[b] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+        rec_time[b] = std::max(0.0, rec_time[b] - det_time);
+    }
+
+    KernelStats stats;
+    stats.name          = "RecBatch";
+    stats.iters         = iters;
+    stats.avgBaseline   = rec_time[0] / iters;
+    stats.avgOptimized  = rec_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(texts[0], texts[1]);
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Character level edit distance between two UTF-8 strings
+static size_t editDistance(const std::string& a, const std::string& b) {
+    auto split = [](const std::string& s) {
+        std::vector<std::string> chars;
+        for (size_t i = 0; i < s.size(); ) {
+            size_t n = 1;
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0xf0) n = 4;
+            else if (c >= 0xe0) n = 3;
+            else if (c >= 0xc0) n = 2;
+            chars.emplace_back(s.substr(i, n));
+            i += n;
+        }
+        return chars;
+    };
+    std::vector<std::string> ca = split(a), cb = split(b);
+    std::vector<size_t> row(cb.size() + 1);
+    std::iota(row.begin(), row.end(), 0);
+    for (size_t i = 1; i <= ca.size(); ++i) {
+        size_t diag = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= cb.size(); ++j) {
+            size_t up = row[j];
+            row[j] = std::min({row[j] + 1, row[j - 1] + 1, diag + (ca[i - 1] == cb[j - 1] ? 0 : 1)});
+            diag = up;
+        }
+    }
+    return row[cb.size()];
+}
+
+// One line made of five copies of the rec demo line (~2900 px at rec height),
+// recognized whole vs cut at 1280 px with overlap, diff is the char edit distance
+// over the length of the whole line result.
+KernelStats benchRecSplit() {
+    const int iters = 10;
+    const std::string image = "output/benchmark/rec_long.png";
+    cv::Mat line = cv::imread("data/images/reg.png");
+    cv::Mat long_line;
+    cv::hconcat(std::vector<cv::Mat>(5, line), long_line);
+    cv::imwrite(image, long_line);
+
+    model::ModelParams rec = recParams();
+
+    const int max_width[2] = {0, 1280};
+    double rec_time[2] = {0.0, 0.0};
+    std::string texts[2];
+    for (int b = 0; b < 2; ++b) {
+        rec.recMaxWidth = max_width[b];
+        std::vector<model::ModelParams> params = {rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        auto first = creator->inference(image);
+        if (!first->regRets.empty()) texts[b] = first->regRets[0];
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            rec_time[b] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "RecSplit";
+    stats.iters         = iters;
+    stats.avgBaseline   = rec_time[0] / iters;
+    stats.avgOptimized  = rec_time[1] / iters;
+    stats.maxDiff       = static_cast<double>(editDistance(texts[0], texts[1]))
+                        / std::max<size_t>(1, editDistance(texts[0], std::string()));
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Five copies of the rec demo line (~2900 px) on a white page, four tiles
+// wide at the default tile size. Whole page at resize_long vs tiled detection,
+// diff is 1 - IoU of the worst matched box pair, a line left cut at a tile
+// border or counted twice fails it.
+KernelStats benchTileMerge() {
+    const int iters = 10;
+    const std::string image = "output/benchmark/tile_long.png";
+    cv::Mat line = cv::imread("data/images/reg.png");
+    cv::Mat long_line;
+    cv::hconcat(std::vector<cv::Mat>(5, line), long_line);
+    cv::Mat page(long_line.rows + 200, long_line.cols + 100, long_line.type(), cv::Scalar::all(255));
+    long_line.copyTo(page(cv::Rect(50, 100, long_line.cols, long_line.rows)));
+    cv::imwrite(image, page);
+
+    model::ModelParams det = detParams();
+
+    const common::det_resize_mode modes[2] = {common::det_resize_mode::RESIZE_LONG,
+                                              common::det_resize_mode::TILED};
+    double det_time[2] = {0.0, 0.0};
+    std::vector<std::vector<cv::Point2f>> boxes[2];
+    for (int b = 0; b < 2; ++b) {
+        det.detResize = modes[b];
+        std::vector<model::ModelParams> params = {det};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        boxes[b] = creator->inference(image)->decBoxes;
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            det_time[b] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+    }
+    std::cout << "TileMerge boxes whole page : " << boxes[0].size()
+              << ", tiled : " << boxes[1].size() << "\n";
+
+    double min_iou = boxes[0].size() == boxes[1].size() && !boxes[0].empty() ? 1.0 : 0.0;
+    for (const auto& r : boxes[0]) {
+        double best = 0.0;
+        for (const auto& o : boxes[1]) best = std::max(best, boxIoU(r, o));
+        min_iou = std::min(min_iou, best);
+    }
+
+    KernelStats stats;
+    stats.name          = "TileMerge";
+    stats.iters         = iters;
+    stats.avgBaseline   = det_time[0] / iters;
+    stats.avgOptimized  = det_time[1] / iters;
+    stats.maxDiff       = 1.0 - min_iou;
+    stats.tolerance     = 0.2;
+    return stats;
+}
+
+// reference CTC decode: scalar argmax with second max bookkeeping and per-char
+// string appends, the former Recognizer::postProcessCpu loop
+static std::string ctcDecodeRef(const float* probs, int steps, int classes,
+                                const std::vector<std::string>& charList) {
+    std::string result;
+    int last_index = -1;
+    for (int t = 0; t < steps; ++t) {
+        const float* step_logits = probs + (size_t) t * classes;
+        int max_index = 0;
+        float max_value = step_logits[0];
+        int second_index = -1;
+        float second_value = -1e9f;
+        for (int c = 1; c < classes; ++c) {
+            float v = step_logits[c];
+            if (v > max_value) {
+                second_value = max_value;
+                second_index = max_index;
+                max_value = v;
+                max_index = c;
+            } else if (v > second_value) {
+                second_value = v;
+                second_index = c;
+            }
+        }
+        (void) second_index;
+        if (max_index != 0 && max_index != last_index && max_index < (int)charList.size()) {
+            result += charList[max_index];
+        }
+        last_index = max_index;
+    }
+    return result;
+}
+
+// 8 lines x 40 steps over the PP-OCRv5 rec class count, steps are mostly blank
+// with a random char peak. Optimized is the SIMD argmax decode plus one reserved
+// string per line, diff is the fraction of lines decoded differently.
+KernelStats benchRecDecode() {
+    const int iters = 20;
+    const int batch = 8, steps = 40, classes = 18385;
+    std::vector<std::string> char_list(classes, "\xe5\xad\x97");
+
+    cv::RNG rng(0x5eed);
+    std::vector<float> probs((size_t) batch * steps * classes);
+    for (size_t i = 0; i < probs.size(); ++i) probs[i] = rng.uniform(0.f, 1e-4f);
+    for (int r = 0; r < batch * steps; ++r) {
+        int peak = rng.uniform(0, 3) ? rng.uniform(1, classes) : 0;
+        probs[(size_t) r * classes + peak] = rng.uniform(0.5f, 1.f);
+    }
+
+    std::vector<std::string> ref(batch), opt(batch);
+    std::vector<int> chars, char_steps;
+    std::vector<float> char_scores;
+    KernelStats stats;
+    stats.name          = "RecDecode";
+    stats.iters         = iters;
+    stats.avgBaseline   = timeKernel(iters, [&]() {
+        for (int b = 0; b < batch; ++b) {
+            ref[b] = ctcDecodeRef(probs.data() + (size_t) b * steps * classes, steps, classes, char_list);
+        }
+    });
+    stats.avgOptimized  = timeKernel(iters, [&]() {
+        for (int b = 0; b < batch; ++b) {
+            ctcGreedyDecode(probs.data() + (size_t) b * steps * classes, steps, classes,
+                            chars, char_steps, char_scores);
+            size_t bytes = 0;
+            for (int c : chars) bytes += char_list[c].size();
+            opt[b].clear();
+            opt[b].reserve(bytes);
+            for (int c : chars) opt[b].append(char_list[c]);
+        }
+    });
+    stats.maxDiff       = lineDiffRatio(ref, opt);
+    stats.tolerance     = 0.0;
+    return stats;
+}
+
+// A rendered line of digits recognized with the whole dict vs a model cut down
+// to the digits, diff is the char edit distance over the whole dict result
+KernelStats benchRecCharset() {
+    const int iters = 20;
+    const std::string image = "output/benchmark/rec_digits.png";
+    cv::Mat line(48, 420, CV_8UC3, cv::Scalar(255, 255, 255));
+    cv::putText(line, "20250316 1479.68", cv::Point(8, 36), cv::FONT_HERSHEY_SIMPLEX, 1.2,
+                cv::Scalar(0, 0, 0), 2, cv::LINE_AA);
+    cv::imwrite(image, line);
+
+    model::ModelParams rec = recParams();
+
+    const std::string charset[2] = {"", "0123456789. "};
+    double rec_time[2] = {0.0, 0.0};
+    int classes[2] = {0, 0};
+    std::string texts[2];
+    for (int b = 0; b < 2; ++b) {
+        rec.recCharset = charset[b];
+        std::vector<model::ModelParams> params = {rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        // a failed restriction keeps the full dict, compare the class counts too
+        classes[b] = creator->recClasses();
+        auto first = creator->inference(image);
+        if (!first->regRets.empty()) texts[b] = first->regRets[0];
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            rec_time[b] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "RecCharset";
+    stats.iters         = iters;
+    stats.avgBaseline   = rec_time[0] / iters;
+    stats.avgOptimized  = rec_time[1] / iters;
+    std::cout << "RecCharset classes full : " << classes[0] << ", restricted : " << classes[1] << "\n";
+    stats.maxDiff       = classes[1] >= classes[0] ? DBL_MAX
+                        : static_cast<double>(editDistance(texts[0], texts[1]))
+                        / std::max<size_t>(1, editDistance(texts[0], std::string()));
+    stats.tolerance     = 0.1;
+    return stats;
+}
+
+// Full det + angle + rec page time reading every line once at full fidelity vs a
+// squeezed first pass with only low-confidence lines re-read, diff is the
+// fraction of lines recognized differently
+KernelStats benchRecEscalate() {
+    const int iters = 10;
+    const std::string image = "data/images/general_ocr_0.png";
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+    model::ModelParams rec = recParams();
+
+    const float thresh[2] = {0.f, 0.9f};
+    double page_time[2] = {0.0, 0.0};
+    std::vector<std::string> texts[2];
+    for (int e = 0; e < 2; ++e) {
+        rec.recEscalateThresh = thresh[e];
+        std::vector<model::ModelParams> params = {det, angle, rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        auto first = creator->inference(image);
+        texts[e] = first->regRets;
+        if (e) {
+            std::cout << "RecEscalate lines : " << first->recLines << ", escalated : " << first->recEscalated
+                      << ", improved : " << first->recImproved << "\n";
+        }
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            page_time[e] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "RecEscalate";
+    stats.iters         = iters;
+    stats.avgBaseline   = page_time[0] / iters;
+    stats.avgOptimized  = page_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(texts[0], texts[1]);
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Full det + angle + rec page time with every det box read vs the crop gate on,
+// on a demo page with table rules and faint smudges drawn over it. Diff is the
+// fraction of boxes whose confident (>= 0.5) read changed or got dropped.
+KernelStats benchCropGate() {
+    const int iters = 10;
+    const std::string image = "output/benchmark/gate_page.png";
+    cv::Mat page = cv::imread("data/images/general_ocr_0.png");
+    if (!page.empty()) {
+        cv::RNG rng(7);
+        for (int i = 0; i < 12; ++i) {
+            int y = rng.uniform(0, page.rows);
+            int x = rng.uniform(0, page.cols / 2);
+            cv::line(page, cv::Point(x, y), cv::Point(x + page.cols / 3, y), cv::Scalar(60, 60, 60), 2);
+        }
+        for (int i = 0; i < 8; ++i) {
+            cv::Rect r(rng.uniform(0, page.cols - 120), rng.uniform(0, page.rows - 30), 120, 24);
+            cv::Mat smudge = page(r);
+            cv::addWeighted(smudge, 0.5, smudge, 0.0, 110.0, smudge);
+        }
+    }
+    cv::imwrite(image, page);
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+    model::ModelParams rec = recParams();
+
+    double page_time[2] = {0.0, 0.0};
+    std::shared_ptr<model::InferResult> first[2];
+    for (int g = 0; g < 2; ++g) {
+        det.cropGate = (g != 0);
+        std::vector<model::ModelParams> params = {det, angle, rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        first[g] = creator->inference(image);
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            page_time[g] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+    }
+    std::cout << "CropGate rejected : " << first[1]->gateRejected << " of "
+              << first[1]->decBoxes.size() << " boxes\n";
+
+    const auto& base  = *first[0];
+    const auto& gated = *first[1];
+    std::vector<char> confident(base.regScores.size());
+    for (size_t i = 0; i < confident.size(); ++i) confident[i] = base.regScores[i] >= 0.5f;
+
+    KernelStats stats;
+    stats.name          = "CropGate";
+    stats.iters         = iters;
+    stats.avgBaseline   = page_time[0] / iters;
+    stats.avgOptimized  = page_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(base.regRets, gated.regRets, confident);
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Page wall time with the angle cls ahead of rec vs rec reading upright while
+// the angle cls runs, diff is the fraction of lines recognized differently
+KernelStats benchRecSpeculate() {
+    const int iters = 10;
+    const std::string image = "data/images/general_ocr_0.png";
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+    model::ModelParams rec = recParams();
+
+    double wall_time[2] = {0.0, 0.0};
+    std::vector<std::string> texts[2];
+    for (int sp = 0; sp < 2; ++sp) {
+        rec.recSpeculate = (sp != 0);
+        std::vector<model::ModelParams> params = {det, angle, rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        texts[sp] = creator->inference(image)->regRets;
+        for (int i = 0; i < iters; ++i) {
+            wall_time[sp] += creator->inference(image)->wallTime;
+        }
+    }
+
+    KernelStats stats;
+    stats.name          = "RecSpeculate";
+    stats.iters         = iters;
+    stats.avgBaseline   = wall_time[0] / iters;
+    stats.avgOptimized  = wall_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(texts[0], texts[1]);
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Angle cls time over the 0/90/180/270 demo pages classifying every line vs a
+// page vote over a line sample, diff is the fraction of lines routed differently
+KernelStats benchAnglePageVote() {
+    const int iters = 10;
+    const std::vector<std::string> images = {
+        "data/images/general_ocr_0.png",
+        "data/images/general_ocr_90.png",
+        "data/images/general_ocr_180.png",
+        "data/images/general_ocr_270.png"
+    };
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+
+    // det alone gives the time to take off the det + angle pipeline
+    std::vector<model::ModelParams> det_only = {det};
+    auto det_creator = ocrcreator::createCreator(det_only, logger::Level::ERROR);
+    double det_time = 0.0;
+    for (const auto& image : images) {
+        det_creator->inference(image);
+        for (int i = 0; i < iters; ++i) {
+            auto rets = det_creator->inference(image);
+            det_time += rets->preTime + rets->inferTime + rets->postTime;
+        }
+    }
+
+    double angle_time[2] = {0.0, 0.0};
+    std::vector<int> routes[2];
+    for (int v = 0; v < 2; ++v) {
+        angle.anglePageVote = (v != 0);
+        std::vector<model::ModelParams> params = {det, angle};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        for (const auto& image : images) {
+            auto first = creator->inference(image);
+            routes[v].insert(routes[v].end(), first->angleRets.begin(), first->angleRets.end());
+            if (v) {
+                std::cout << "AnglePageVote " << image << " : page angle " << first->pageAngle
+                          << ", per-line " << first->angleFallback << " of " << first->angleRets.size() << "\n";
+            }
+            for (int i = 0; i < iters; ++i) {
+                auto rets = creator->inference(image);
+                angle_time[v] += rets->preTime + rets->inferTime + rets->postTime;
+            }
+        }
+        angle_time[v] = std::max(0.0, angle_time[v] - det_time);
+    }
+
+    KernelStats stats;
+    stats.name          = "AnglePageVote";
+    stats.iters         = iters;
+    stats.avgBaseline   = angle_time[0] / (iters * images.size());
+    stats.avgOptimized  = angle_time[1] / (iters * images.size());
+    stats.maxDiff       = lineDiffRatio(routes[0], routes[1]);
+    stats.tolerance     = 0.05;
+    return stats;
+}
+
+// Angle cls time with every line of a page in one run vs micro-batches of 8
+// through two reused buffers, diff is the fraction of lines routed differently
+KernelStats benchAngleBatch() {
+    const int iters = 10;
+    const std::string image = "data/images/general_ocr_0.png";
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+
+    // det alone gives the time to take off the det + angle pipeline
+    std::vector<model::ModelParams> det_only = {det};
+    auto det_creator = ocrcreator::createCreator(det_only, logger::Level::ERROR);
+    det_creator->inference(image);
+    double det_time = 0.0;
+    for (int i = 0; i < iters; ++i) {
+        auto rets = det_creator->inference(image);
+        det_time += rets->preTime + rets->inferTime + rets->postTime;
+    }
+
+    const int batch_size[2] = {INT_MAX, 8};
+    double angle_time[2] = {0.0, 0.0};
+    std::vector<int> routes[2];
+    for (int b = 0; b < 2; ++b) {
+        angle.angleBatchSize = batch_size[b];
+        std::vector<model::ModelParams> params = {det, angle};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        routes[b] = creator->inference(image)->angleRets;
+        size_t lines = std::min<size_t>(routes[b].size(), batch_size[b]);
+        std::cout << "AngleBatch " << (b ? "chunked" : "single") << " input buffers : "
+                  << (b ? 2 : 1) * lines * 3 * 80 * 160 * sizeof(float) / (1024.0 * 1024.0) << " MB\n";
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            angle_time[b] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+        angle_time[b] = std::max(0.0, angle_time[b] - det_time);
+    }
+
+    KernelStats stats;
+    stats.name          = "AngleBatch";
+    stats.iters         = iters;
+    stats.avgBaseline   = angle_time[0] / iters;
+    stats.avgOptimized  = angle_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(routes[0], routes[1]);
+    stats.tolerance     = 0.0;
+    return stats;
+}
+
+// Full det + angle + rec page time with ORT allocating every run vs IoBinding
+// through persistent per-shape buffers. Tensor allocations are counted after two
+// warm-up pages. Diff is the fraction of lines read differently plus the bound
+// steady state allocations, both have to be 0.
+KernelStats benchIoBinding() {
+    const int iters = 10;
+    const std::string image = "data/images/general_ocr_0.png";
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+    model::ModelParams rec = recParams();
+
+    double page_time[2] = {0.0, 0.0};
+    uint64_t allocs[2] = {0, 0};
+    std::vector<std::string> texts[2];
+    for (int b = 0; b < 2; ++b) {
+        det.ioBinding = angle.ioBinding = rec.ioBinding = (b != 0);
+        std::vector<model::ModelParams> params = {det, angle, rec};
+        auto creator = ocrcreator::createCreator(params, logger::Level::ERROR);
+        texts[b] = creator->inference(image)->regRets;
+        creator->inference(image);
+        uint64_t before = model::tensorAllocations();
+        for (int i = 0; i < iters; ++i) {
+            auto rets = creator->inference(image);
+            page_time[b] += rets->preTime + rets->inferTime + rets->postTime;
+        }
+        allocs[b] = model::tensorAllocations() - before;
+        std::cout << "IoBinding " << (b ? "bound" : "plain") << " tensor allocations per page : "
+                  << static_cast<double>(allocs[b]) / iters << "\n";
+    }
+
+    KernelStats stats;
+    stats.name          = "IoBinding";
+    stats.iters         = iters;
+    stats.avgBaseline   = page_time[0] / iters;
+    stats.avgOptimized  = page_time[1] / iters;
+    stats.maxDiff       = lineDiffRatio(texts[0], texts[1])
+                        + static_cast<double>(allocs[1]);
+    stats.tolerance     = 0.0;
+    return stats;
+}
+
+// Three pipelines (det + angle + rec) serving pages concurrently, every session
+// with a private pool sized to the whole machine vs all nine sessions on the
+// shared global pools. Time is wall ms per page, diff is the fraction of lines
+// recognized differently.
+KernelStats benchSharedPools() {
+    const int workers = 3;
+    const int pages = 6;
+    const std::string image = "data/images/general_ocr_0.png";
+    int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    model::ModelParams det = detParams();
+    model::ModelParams angle = angleParams();
+    model::ModelParams rec = recParams();
+
+    double ms_per_page[2] = {0.0, 0.0};
+    std::vector<std::string> texts[2];
+    for (int shared = 0; shared < 2; ++shared) {
+        det.sharedThreadPool = angle.sharedThreadPool = rec.sharedThreadPool = (shared != 0);
+        det.intraThreadnum = angle.intraThreadnum = rec.intraThreadnum = cores;
+
+        std::vector<std::shared_ptr<ocrcreator::Creator>> creators;
+        for (int w = 0; w < workers; ++w) {
+            std::vector<model::ModelParams> params = {det, angle, rec};
+            creators.push_back(ocrcreator::createCreator(params, logger::Level::ERROR));
+            creators.back()->inference(image);
+        }
+        texts[shared] = creators[0]->inference(image)->regRets;
+
+        double total = timeKernel(1, [&]() {
+            std::vector<std::thread> threads;
+            for (int w = 0; w < workers; ++w) {
+                threads.emplace_back([&, w]() {
+                    for (int p = 0; p < pages; ++p) creators[w]->inference(image);
+                });
+            }
+            for (auto& t : threads) t.join();
+        });
+        ms_per_page[shared] = total / (workers * pages);
+        std::cout << "SharedPools " << (shared ? "shared" : "per-session") << " pages/sec : "
+                  << 1000.0 / ms_per_page[shared] << "\n";
+    }
+
+    KernelStats stats;
+    stats.name          = "SharedPools";
+    stats.iters         = workers * pages;
+    stats.avgBaseline   = ms_per_page[0];
+    stats.avgOptimized  = ms_per_page[1];
+    stats.maxDiff       = lineDiffRatio(texts[0], texts[1]);
+    stats.tolerance     = 0.0;
+    return stats;
+}
+
+// 300 line crops of a demo page, a third each axis-aligned, rotated and skewed.
+// Baseline is the former bicubic warpPerspective for every box, optimized is
+// cropQuad with the same interpolation. Diff covers rotated/skewed boxes only,
+// axis-aligned ones are a ROI view instead of a resampled copy. warpAffine and
+// warpPerspective round sample positions differently, a few gray levels at edges.
+KernelStats benchCropQuad() {
+    const int iters = 20;
+    cv::Mat page = cv::imread("data/images/general_ocr_0.png");
+
+    cv::RNG rng(0x5eed);
+    std::vector<std::array<cv::Point2f, 4>> quads(300);
+    std::vector<cv::Size2f> sizes(quads.size());
+    for (size_t i = 0; i < quads.size(); ++i) {
+        float w = rng.uniform(40.f, 300.f);
+        float h = rng.uniform(16.f, 48.f);
+        cv::Point2f c(rng.uniform(w, page.cols - w), rng.uniform(h, page.rows - h));
+        float angle = (i % 3 == 0) ? 0.f : rng.uniform(-15.f, 15.f);
+        cv::Point2f pts[4];
+        cv::RotatedRect(c, cv::Size2f(w, h), angle).points(pts);
+        // points() is bl, tl, tr, br
+        quads[i] = {pts[1], pts[2], pts[3], pts[0]};
+        if (i % 3 == 2) {
+            quads[i][2] += cv::Point2f(rng.uniform(-3.f, 3.f), rng.uniform(-3.f, 3.f));
+        }
+        sizes[i] = cv::Size2f(w, h);
+    }
+
+    std::vector<cv::Mat> ref(quads.size()), opt(quads.size());
+    KernelStats stats;
+    stats.name          = "DetCropQuad";
+    stats.iters         = iters;
+    stats.avgBaseline   = timeKernel(iters, [&]() {
+        for (size_t i = 0; i < quads.size(); ++i) {
+            cv::Point2f dst_pts[4] = {
+                {0.f, 0.f},
+                {sizes[i].width - 1.f, 0.f},
+                {sizes[i].width - 1.f, sizes[i].height - 1.f},
+                {0.f, sizes[i].height - 1.f}
+            };
+            cv::Mat perspect_mat = cv::getPerspectiveTransform(quads[i].data(), dst_pts);
+            cv::warpPerspective(page, ref[i], perspect_mat,
+                                cv::Size((int)sizes[i].width, (int)sizes[i].height),
+                                cv::INTER_CUBIC, cv::BORDER_REPLICATE);
+        }
+    });
+    stats.avgOptimized  = timeKernel(iters, [&]() {
+        for (size_t i = 0; i < quads.size(); ++i) {
+            opt[i] = cropQuad(page, quads[i].data(), sizes[i].width, sizes[i].height, cv::INTER_CUBIC);
+        }
+    });
+    stats.maxDiff       = 0.0;
+    for (size_t i = 0; i < quads.size(); ++i) {
+        if (i % 3 == 0) continue;
+        stats.maxDiff = std::max(stats.maxDiff, cv::norm(ref[i], opt[i], cv::NORM_INF));
+    }
+    stats.tolerance     = 8.0;
+    return stats;
+}
+
+std::shared_ptr<StatsNode> benchmark(const std::string imagePath, int intraThnum, int interThnum, common::task_type task) {
+    const int warmup_iters = 10;
+    const int bench_iters  = 100;
+    const auto log_level = logger::Level::ERROR;
+    std::shared_ptr<StatsNode> stats = std::make_shared<StatsNode>();
+
+    model::ModelParams det = detParams();
+    det.intraThreadnum      = intraThnum;
+    det.interThreadnum      = interThnum;
+    det.postThreadnum       = intraThnum;   // postprocess runs while ORT workers idle
+
+    model::ModelParams angle = angleParams();
+    angle.intraThreadnum    = intraThnum;
+    angle.interThreadnum    = interThnum;
+
+    model::ModelParams rec = recParams();
     rec.intraThreadnum      = intraThnum;
     rec.interThreadnum      = interThnum;
 
@@ -158,6 +1324,7 @@ std::shared_ptr<StatsNode> benchmark(const std::string imagePath, int intraThnum
     std::vector<double> infer_times;
     std::vector<double> post_times;
     std::vector<double> total_times;
+    std::vector<double> post_areas;
 
     pre_times.reserve(bench_iters);
     infer_times.reserve(bench_iters);
@@ -176,6 +1343,7 @@ std::shared_ptr<StatsNode> benchmark(const std::string imagePath, int intraThnum
         infer_times.emplace_back(infer);
         post_times.emplace_back(post);
         total_times.emplace_back(total);
+        post_areas.emplace_back(rets->detPostArea);
     }
 
     stats->inferBackend = common::infer_backend::ORT_CPU;
@@ -191,6 +1359,7 @@ std::shared_ptr<StatsNode> benchmark(const std::string imagePath, int intraThnum
     stats->avgTotal     = mean(total_times);
     stats->p90Total     = percentile(total_times, 0.90);
     stats->p99Total     = percentile(total_times, 0.99);
+    stats->avgPostArea  = mean(post_areas);
     return stats;
 }
 
@@ -202,6 +1371,42 @@ int main() {
         return -1;
     }
 
+    // global pools for the SharedPools row, sessions without sharedThreadPool
+    // keep their own pools as before
+    model::GlobalThreadPools pools;
+    pools.intraThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    model::OrtEnvSingleton::useGlobalThreadPools(pools);
+
+    // 后处理算子
+    std::vector<KernelStats> kernel_array;
+    kernel_array.emplace_back(benchBinarize());
+    kernel_array.emplace_back(benchScoreFast());
+    kernel_array.emplace_back(benchUnclip());
+    kernel_array.emplace_back(benchUnclipDemo());
+    kernel_array.emplace_back(benchCandidates());
+    kernel_array.emplace_back(benchCropQuad());
+    for (int th : values) {
+        kernel_array.emplace_back(benchDetBatch(th));
+    }
+    kernel_array.emplace_back(benchDetPack());
+    kernel_array.emplace_back(benchFusedCrop());
+    kernel_array.emplace_back(benchRecBatch());
+    kernel_array.emplace_back(benchRecSplit());
+    kernel_array.emplace_back(benchRecDecode());
+    kernel_array.emplace_back(benchRecCharset());
+    kernel_array.emplace_back(benchRecEscalate());
+    kernel_array.emplace_back(benchCropGate());
+    kernel_array.emplace_back(benchRecSpeculate());
+    kernel_array.emplace_back(benchAnglePageVote());
+    kernel_array.emplace_back(benchAngleBatch());
+    kernel_array.emplace_back(benchIoBinding());
+    kernel_array.emplace_back(benchSharedPools());
+    kernel_array.emplace_back(benchTileMerge());
+    for (auto& k : kernel_array) {
+        kernelShow(k);
+    }
+    exportKernelCSV(kernel_array);
+
     // 文本检测
     std::vector<StatsNode> stats_array;
     const std::string dec_image_path = "data/images/general_ocr_0.png";
@@ -9,6 +9,7 @@
 #include "common.hpp"
 #include "logger.hpp"
 #include "model.hpp"
+#include "threadpool.hpp"
 
 namespace model{
 
@@ -18,16 +19,24 @@ public:
     Anglecls(ModelParams &params, logger::Level level);
 
 public:
+    virtual void inference(InferContext& ctx, std::string imagePath) override;
     virtual void setup(void const* data, std::size_t size) override;
     virtual bool preProcessCpu(InferContext& ctx) override;
     virtual bool postProcessCpu(InferContext& ctx) override;
     virtual bool preProcessCuda(InferContext& ctx) override;
     virtual bool postProcessCuda(InferContext& ctx) override;
+private:
+    bool parseYaml(const std::string& yaml);
+    void fillChunk(const InferContext& ctx, int first, int count, float* dst);
+    void classify(InferContext& ctx);
+
 private:
     int                                     m_channels  = 3;
     int                                     m_dstHeight = 80;
     int                                     m_dstWidth  = 160;
     float                                   m_scale     = 0.00392156862745098f;
+    std::vector<float>                      m_chunks[2];    // input of the running and the next micro-batch
+    std::unique_ptr<threadpool::ThreadPool> m_fillPool;     // one worker, fills the next micro-batch
 };
 
 std::shared_ptr<Anglecls> makeAnglecls(ModelParams &params, logger::Level level);
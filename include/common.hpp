@@ -27,6 +27,26 @@ namespace common{
         TRT,
     };
 
+    enum det_resize_mode {
+        LETTERBOX = 0,
+        RESIZE_LONG,
+        TILED,
+    };
+
+    enum det_region_mode {
+        CONTOURS = 0,
+        COMPONENTS,
+    };
+
+    // why the crop gate dropped a det box before cls/rec
+    enum crop_gate_reason {
+        CROP_KEPT = 0,
+        CROP_LOW_HEIGHT,
+        CROP_ELONGATED,
+        CROP_LOW_CONTRAST,
+        CROP_LOW_INK,
+    };
+
 };
 
 #endif //__COMMON_HPP__
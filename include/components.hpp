@@ -0,0 +1,49 @@
+#ifndef __COMPONENTS_HPP__
+#define __COMPONENTS_HPP__
+
+#include <vector>
+#include "opencv2/core.hpp"
+
+namespace components{
+
+struct Component {
+    int     area;
+    int     xmin;
+    int     ymin;
+    int     xmax;
+    int     ymax;
+    double  scoreSum;
+};
+
+// 8-connected component labeling of a binary map. Each horizontal stripe is
+// labeled in a single raster scan that also accumulates area/bbox/score per
+// label, stripes are then stitched along their borders with a union-find.
+class RegionExtractor {
+public:
+    void label(const cv::Mat& bitmap, const cv::Mat& prob, int stripes);
+    const std::vector<Component>& components() const { return m_comps; }
+    void boundary(int index, std::vector<cv::Point2f>& points) const;
+
+private:
+    struct Stripe {
+        int                     y0;
+        int                     y1;
+        int                     offset;
+        std::vector<int>        parent;
+        std::vector<Component>  stats;
+    };
+
+    void labelStripe(Stripe& stripe, const cv::Mat& bitmap, const cv::Mat& prob);
+    int  componentAt(int x, int y) const;
+
+private:
+    cv::Mat                 m_labels;   // stripe local labels, 0 is background
+    std::vector<Stripe>     m_stripes;
+    std::vector<int>        m_stripeOf; // row -> stripe index
+    std::vector<int>        m_compOf;   // global label -> component index
+    std::vector<Component>  m_comps;
+};
+
+}; // namespace components
+
+#endif //__COMPONENTS_HPP__
@@ -0,0 +1,94 @@
+#ifndef __CONFIGCACHE_HPP__
+#define __CONFIGCACHE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace configcache{
+
+// Strings packed in one blob with an offset table, entry i is
+// blob[offsets[i], offsets[i + 1]). Either owns its storage or views a mapped
+// cache file, lookups never build a std::string.
+class CharTable {
+public:
+    CharTable() = default;
+    CharTable(CharTable&& other);
+    CharTable& operator=(CharTable&& other);
+    CharTable(const CharTable&) = delete;
+    CharTable& operator=(const CharTable&) = delete;
+
+    int         size() const { return m_count; }
+    const char* data(int i) const { return m_blob + m_offsets[i]; }
+    size_t      length(int i) const { return m_offsets[i + 1] - m_offsets[i]; }
+    void        append(std::string& out, int i) const { out.append(data(i), length(i)); }
+    bool        equals(int i, const char* s, size_t n) const;
+
+    void        push_back(const char* s, size_t n);
+    void        view(const char* blob, const uint32_t* offsets, int count);
+
+    const char*     blob() const { return m_blob; }
+    const uint32_t* offsets() const { return m_offsets; }
+
+private:
+    void refresh();
+
+private:
+    std::string             m_ownBlob;
+    std::vector<uint32_t>   m_ownOffsets{0};
+    bool                    m_mapped    = false;
+    const char*             m_blob      = "";
+    const uint32_t*         m_offsets   = m_ownOffsets.data();
+    int                     m_count     = 0;
+};
+
+// Compiled form of an inference.yml next to it (<yaml>.bin), tagged with the
+// FNV-1a hash of the yaml text. Values are bound to members up front: load()
+// maps a cache whose hash matches and fills them, on a miss the caller parses
+// yaml() and save() writes the bound values back. The yaml text is dropped once
+// either succeeds. A bound table views the mapping, so the cache has to outlive it.
+class ConfigCache {
+public:
+    explicit ConfigCache(const std::string& yamlPath);
+    ~ConfigCache();
+    ConfigCache(const ConfigCache&) = delete;
+    ConfigCache& operator=(const ConfigCache&) = delete;
+
+    void bind(const char* key, float* values, int count = 1);
+    void bind(const char* key, int* value);
+    void bind(CharTable* table);
+
+    bool load();
+    bool save();
+
+    bool               opened() const { return m_opened; }
+    const std::string& yaml() const { return m_yaml; }
+
+private:
+    struct Binding {
+        std::string     key;
+        float*          floats;
+        int*            ints;
+        int             count;
+    };
+
+    void unmap();
+    void releaseYaml();
+
+private:
+    std::string             m_yamlPath;
+    std::string             m_cachePath;
+    std::string             m_yaml;
+    uint64_t                m_hash      = 0;
+    bool                    m_opened    = false;
+    std::vector<Binding>    m_bindings;
+    CharTable*              m_table     = nullptr;
+    void*                   m_map       = nullptr;
+    size_t                  m_mapSize   = 0;
+};
+
+uint64_t fnv1a(const char* data, size_t size);
+
+}; // namespace configcache
+
+#endif //__CONFIGCACHE_HPP__
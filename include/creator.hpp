@@ -13,6 +13,15 @@ class Creator {
 public:
     Creator(std::vector<model::ModelParams> &paramList, logger::Level level);
     std::shared_ptr<model::InferResult> inference(const std::string &imagePath);
+    std::vector<std::shared_ptr<model::InferResult>> inference(const std::vector<std::string> &imagePaths);
+    int recClasses() const;     // classes the recognizer decodes into, 0 without one
+
+private:
+    void collectDetection(model::InferContext &det_ctx, model::InferResult &rets);
+    void inferenceCrops(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets);
+    void readCrops(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets);
+    void rerunFlipped(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets);
+    void escalateLines(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets);
 
 private:
     std::shared_ptr<logger::Logger>     m_logger;
@@ -10,16 +10,37 @@
 #include "common.hpp"
 #include "logger.hpp"
 #include "model.hpp"
+#include "components.hpp"
+#include "threadpool.hpp"
 
 namespace model{
 
 namespace detectioner {
+
+// map coordinates -> source coordinates: (p - pad) / scale + offset
+struct DetTransform {
+    float       scale   = 1.f;
+    int         padTop  = 0;
+    int         padLeft = 0;
+    cv::Point2f offset  = {0.f, 0.f};
+    cv::Rect    valid;  // content region of the map, empty means the whole map
+};
+
+// images sharing one det input, places are their positions in a packed
+// canvas, empty for a single image that is resized as usual
+struct DetCanvas {
+    std::vector<int>        images;
+    std::vector<cv::Rect>   places;
+};
+
 class Detectioner : public Model{
 
 public:
     Detectioner(ModelParams &params, logger::Level level, float minSide=3);
 
 public:
+    virtual void inference(InferContext& ctx, std::string imagePath) override;
+    virtual void inferenceBatch(std::vector<InferContext>& ctxs, const std::vector<std::string>& imagePaths) override;
     virtual void setup(void const* data, std::size_t size) override;
     virtual bool preProcessCpu(InferContext& ctx) override;
     virtual bool postProcessCpu(InferContext& ctx) override;
@@ -27,9 +48,18 @@ public:
     virtual bool postProcessCuda(InferContext& ctx) override;
 
 private:
+    bool parseYaml(const std::string& yaml);
     std::pair<std::vector<cv::Point2f>, float> getMiniBoxes(const std::vector<cv::Point2f> &contour);
     float getScoreFast(const cv::Mat &bitmap, const std::vector<cv::Point2f> &contour);
     std::vector<cv::Point2f> unClip(const std::vector<cv::Point2f> &box, float unClipRatio);
+    void findComponents(const cv::Mat& probMap, std::vector<std::vector<cv::Point2f>>& contours);
+    void extractBoxes(const cv::Mat& probMap, const DetTransform& trans, const cv::Size& srcSize, std::vector<BoxWithCoord>& boxes);
+    void mergeBoxes(std::vector<BoxWithCoord>& boxes, int overlap);
+    void cropBoxes(InferContext& ctx, std::vector<BoxWithCoord>& boxes);
+    int gateCrop(const cv::Mat& src, const RoiQuad& quad, const cv::Mat& crop);
+    bool inferenceTiled(InferContext& ctx);
+    void planCanvases(std::vector<InferContext>& ctxs, std::vector<DetCanvas>& canvases);
+    void runCanvases(std::vector<InferContext>& ctxs, const DetCanvas* canvases, int count);
 
 private:
     float   m_textThresh;
@@ -37,10 +67,17 @@ private:
     float   m_minSide;
     float   m_unClipRatio;
     int     m_maxCandidates;
+    int     m_limitSideLen  = 960;
 
     float   m_scale;
     int     m_padTop;
     int     m_padLeft;
+    cv::Rect m_validRect;
+
+    cv::Mat m_bitMap;
+    std::vector<float> m_batchInput;
+    components::RegionExtractor m_extractor;
+    std::unique_ptr<threadpool::ThreadPool> m_pool;
 };
 
 std::shared_ptr<Detectioner> makeDetectioner(ModelParams &params, logger::Level level, float minSide=3);
@@ -1,9 +1,11 @@
 #ifndef __MODEL_HPP__
 #define __MODEL_HPP__
 
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
+#include <cstdint>
 #include "common.hpp"
 #include "timer.hpp"
 #include "logger.hpp"
@@ -27,16 +29,71 @@ struct BoxWithCoord {
     float left;
 };
 
+// text line of a det box in the source image: corners tl, tr, br, bl, and the
+// size of its perspective crop
+struct RoiQuad {
+    cv::Point2f pts[4];
+    float       width;
+    float       height;
+};
+
 struct ModelParams {
     common::infer_backend       inferBackend        = common::infer_backend::ORT_CPU;
     common::task_type           task                = common::task_type::DETECTION;
     common::precision           prec                = common::FP32;
+    common::det_resize_mode     detResize           = common::det_resize_mode::LETTERBOX;
+    common::det_region_mode     detRegion           = common::det_region_mode::CONTOURS;
     ImageInfo                   img                 = {3, 960, 960};
     std::string                 onnxPath;
     std::string                 inferYaml;
     int                         intraThreadnum      = 1;
     int                         interThreadnum      = 1;
+    int                         postThreadnum       = 1;    // workers for det box extraction/cropping
     bool                        saveImg             = false;
+    int                         tileSize            = 960;
+    int                         tileOverlap         = 128;
+    int                         tileBatch           = 4;
+    float                       tileMergeThresh     = 0.5f;
+    int                         detBatch            = 8;        // canvases per det Session::Run in batch mode
+    bool                        detPack             = false;    // pack small images into shared det canvases
+    int                         packMaxSide         = 480;      // long side limit of a packed image
+    int                         packGap             = 32;       // guard gap between packed images
+    bool                        fusedCrop           = true;     // sample det quads straight into cls/rec tensors
+    bool                        keepCrops           = false;    // still materialize the line crops in roiMats
+    int                         cropInterp          = cv::INTER_LINEAR; // interpolation of materialized line crops
+    int                         recBatchSize        = 8;        // lines per rec run, 1 runs them one by one
+    std::vector<int>            recBuckets          = {160, 320, 640, 1280}; // rec pad widths
+    int                         recMaxWidth         = 0;        // rec width a line is cut at, 0 keeps lines whole
+    int                         recOverlap          = 96;       // rec px shared by neighbouring segments
+    std::string                 recCharset;                     // chars rec may output, empty keeps the whole dict
+    float                       recEscalateThresh   = 0.f;      // lines below this confidence are re-read, 0 reads once
+    float                       recCheapScale       = 0.75f;    // rec width scale of the first pass when escalating
+    bool                        recSpeculate        = false;    // read lines upright while the angle cls runs
+    int                         angleBatchSize      = 8;        // crops per angle cls run, the trt max batch
+    bool                        anglePageVote       = false;    // classify a line sample and route the page by vote
+    int                         anglePageSample     = 8;        // lines classified for the page vote
+    float                       anglePageAgree      = 0.75f;    // share of the sample the vote needs
+    bool                        fastUnclip          = true;     // closed-form unclip for rectangles
+    bool                        ioBinding           = false;    // run through persistent per-shape bound buffers
+    int                         ioBindingShapes     = 16;       // bound shapes kept per session, least recently used go
+    bool                        sharedThreadPool    = false;    // run on the env's global pools, not private ones
+    bool                        cropGate            = false;    // drop hopeless det crops before cls/rec
+    float                       gateMinHeight       = 6.f;      // crop height in src px
+    float                       gateMaxAspect       = 100.f;    // crop width / height, 0 disables
+    float                       gateMinContrast     = 8.f;      // gray stddev of the crop
+    float                       gateMinInk          = 0.02f;    // minority share of the Otsu split
+};
+
+// Input and output buffers of one input shape, bound to the session while that
+// shape runs. The output buffer takes its shape from the first run.
+struct ShapeBinding {
+    std::vector<int64_t>    inShape;
+    std::vector<int64_t>    outShape;
+    std::vector<float>      input;
+    std::vector<float>      output;
+    Ort::Value              inTensor{nullptr};
+    Ort::Value              outTensor{nullptr};
+    uint64_t                lastUse = 0;
 };
 
 struct InferContext {
@@ -45,34 +102,82 @@ struct InferContext {
     std::vector<float>                    inputValues;
     std::vector<int64_t>                  inputShape;
     Ort::Value                            inputTensor{nullptr};
+    ShapeBinding*                         binding = nullptr;    // bound buffers of the next run, null runs inputTensor
     std::vector<Ort::Value>               outputTensor;
     std::vector<std::vector<cv::Point2f>> boxes;
-    std::vector<cv::Mat>                  roiMats;
+    std::vector<RoiQuad>                  roiQuads;
+    std::vector<cv::Mat>                  roiMats;  // empty when the crops are fused
     std::vector<int>                      roiRoutes;
+    std::vector<int>                      roiGates;     // crop_gate_reason per roi, empty when ungated
     std::vector<std::string>              regResults;
+    std::vector<std::vector<int>>         regChars;     // class index of every decoded char
+    std::vector<std::vector<int>>         regSteps;     // CTC timestep of every decoded char
+    std::vector<std::vector<float>>       regCharScores; // probability of every decoded char
+    std::vector<float>                    regScores;    // mean char probability per line
     double                                preTime;
     double                                inferTime;
     double                                postTime;
+    double                                postArea = 1.0;   // postprocessed fraction of the det map
+    float                                 recWidthScale = 1.f;  // horizontal squeeze of the rec input
+    int                                   pageAngle = -1;       // clockwise page rotation by the angle vote, -1 undecided
+    int                                   angleFallback = 0;    // lines the angle cls ran on outside the page sample
+    bool                                  failed = false;       // image unreadable, the page is skipped
 };
 
 struct InferResult {
     std::vector<std::vector<cv::Point2f>>   decBoxes;
+    std::vector<RoiQuad>                    decQuads;
     std::vector<cv::Mat>                    decRets;
     std::vector<int>                        angleRets;
+    std::vector<int>                        gateRets;   // crop_gate_reason per det box, empty when ungated
     std::vector<std::string>                regRets;
+    std::vector<float>                      regScores;
+    std::vector<std::vector<float>>         regCharScores;
     double                                  preTime = 0.0;
     double                                  inferTime = 0.0;
     double                                  postTime = 0.0;
+    double                                  detPostArea = 1.0;
+    double                                  wallTime = 0.0;     // ms the page took end to end, stages may overlap
+    int                                     recLines = 0;       // lines read by the first rec pass
+    int                                     recEscalated = 0;   // lines re-read at full fidelity
+    int                                     recImproved = 0;    // re-reads that beat the first pass
+    int                                     recRerun = 0;       // speculative reads redone after the angle cls
+    int                                     pageAngle = -1;     // clockwise page rotation by the angle vote, -1 undecided
+    int                                     angleFallback = 0;  // lines classified one by one
+    int                                     gateRejected = 0;   // det boxes the crop gate dropped
+    bool                                    failed = false;     // image unreadable, no result
+};
+
+// Sizing of the process wide ORT thread pools, sessions with sharedThreadPool
+// run on them instead of private pools
+struct GlobalThreadPools {
+    int         intraThreads    = 0;        // 0 lets ORT use one per core
+    int         interThreads    = 0;
+    bool        spin            = true;     // workers spin a while before they sleep
+    std::string intraAffinity;              // ORT affinity string, e.g. "1;2;3", empty leaves it to the OS
 };
 
 class OrtEnvSingleton {
 public:
     static Ort::Env& ort_env() {
-        static Ort::Env env(ORT_LOGGING_LEVEL_ERROR, "PaddleOCR-ONNX");
+        static Ort::Env env = createEnv();
         return env;
     }
+    // only takes effect before the first session, false once the env exists
+    static bool useGlobalThreadPools(const GlobalThreadPools& pools);
+    static bool globalThreadPools() { return pools() != nullptr; }
+
 private:
     OrtEnvSingleton() = delete;
+    static Ort::Env createEnv();
+    static std::unique_ptr<GlobalThreadPools>& pools() {
+        static std::unique_ptr<GlobalThreadPools> p;
+        return p;
+    }
+    static bool& created() {
+        static bool c = false;
+        return c;
+    }
 };
 
 class Model {
@@ -82,10 +187,13 @@ public:
     virtual ~Model() {};
     void loadData(); 
     void initModel();
-    void inference(InferContext& ctx, std::string imagePath);
+    virtual void inference(InferContext& ctx, std::string imagePath);
+    virtual void inferenceBatch(std::vector<InferContext>& ctxs, const std::vector<std::string>& imagePaths);
 
 public:
     bool enqueueBindings(InferContext& ctx);
+    float* inputBuffer(InferContext& ctx, const std::vector<int64_t>& shape, std::vector<float>& storage, int slot = 0);
+    float* reserveInput(const std::vector<int64_t>& shape, std::vector<float>& storage, int slot = 0);
     virtual void setup(void const* data, std::size_t size)      = 0;
     virtual bool preProcessCpu(InferContext& ctx)               = 0;
     virtual bool postProcessCpu(InferContext& ctx)              = 0;
@@ -97,6 +205,7 @@ public:
     Ort::Env&                                   m_onnxEnv = OrtEnvSingleton::ort_env();
     std::shared_ptr<Ort::Session>               m_onnxSession;
     Ort::SessionOptions                         m_onnxOptions;
+    std::string                                 m_modelData;    // derived model, loaded instead of onnxPath when set
     std::unique_ptr<char[], decltype(&free)>    m_inputName;
     std::unique_ptr<char[], decltype(&free)>    m_outputName;
 
@@ -106,8 +215,22 @@ public:
     float                                       m_normValues[NORMALIZE_DIMS_MAX] = {0.225, 0.224, 0.229};
     std::shared_ptr<logger::Logger>             m_logger;
     std::shared_ptr<timer::Timer>               m_timer;
+
+private:
+    ShapeBinding* reserveBinding(const std::vector<int64_t>& shape, int slot);
+    void runBound(InferContext& ctx);
+
+private:
+    std::map<std::pair<std::vector<int64_t>, int>, ShapeBinding>    m_shapeBindings;
+    std::unique_ptr<Ort::IoBinding>             m_ioBinding;
+    ShapeBinding*                               m_boundNow = nullptr;
+    std::vector<ShapeBinding*>                  m_slotNow;      // last binding reserved per slot, pending a run
+    uint64_t                                    m_useClock = 0;
 };
 
+// float tensor buffers allocated for session inputs/outputs so far, process wide
+uint64_t tensorAllocations();
+
 }; // namespace model
 
 #endif //__MODEL_HPP__
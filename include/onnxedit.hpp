@@ -0,0 +1,20 @@
+#ifndef __ONNXEDIT_HPP__
+#define __ONNXEDIT_HPP__
+
+#include <string>
+#include <vector>
+
+namespace onnxedit{
+
+// Edits an ONNX model straight on its protobuf wire format, no protobuf runtime.
+// restrictClasses cuts the classifier of a CTC head down to the kept classes: the
+// single float [hidden, classes] initializer keeps the kept columns, the
+// [classes] bias the kept entries, both in keep order. Graph outputs and
+// value_info dims equal to classes become keep.size(). Returns false and leaves
+// out empty when the model has no such classifier.
+bool restrictClasses(const std::vector<unsigned char>& model, int classes,
+                     const std::vector<int>& keep, std::string& out);
+
+}; // namespace onnxedit
+
+#endif //__ONNXEDIT_HPP__
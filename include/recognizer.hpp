@@ -9,6 +9,7 @@
 #include "common.hpp"
 #include "logger.hpp"
 #include "model.hpp"
+#include "configcache.hpp"
 
 namespace model{
 
@@ -18,18 +19,27 @@ public:
     Recognizer(ModelParams &params, logger::Level level);
 
 public:
+    virtual void inference(InferContext& ctx, std::string imagePath) override;
     virtual void setup(void const* data, std::size_t size) override;
     virtual bool preProcessCpu(InferContext& ctx) override;
     virtual bool postProcessCpu(InferContext& ctx) override;
     virtual bool preProcessCuda(InferContext& ctx) override;
     virtual bool postProcessCuda(InferContext& ctx) override;
+
+    // classes rec decodes into, blank included; below the dict size once recCharset took effect
+    int classes() const { return m_charTable.size(); }
+private:
+    bool parseYaml(const std::string& yaml);
+    void restrictCharset(const std::string& charset);
+
 private:
     int                                     m_channels  = 3;
     int                                     m_dstHeight = 48;
     int                                     m_dstWidth  = 320;
     float                                   m_scale;
-    std::vector<std::string>                m_characterList;
-    std::unordered_map<int, std::string>    m_keys;
+    int                                     m_padWidth  = 0;    // bucket width of the current run
+    configcache::ConfigCache                m_config;       // maps the dict viewed by m_charTable
+    configcache::CharTable                  m_charTable;
 };
 
 std::shared_ptr<Recognizer> makeRecognizer(ModelParams &params, logger::Level level);
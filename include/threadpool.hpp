@@ -0,0 +1,48 @@
+#ifndef __THREADPOOL_HPP__
+#define __THREADPOOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threadpool{
+
+// Fixed set of workers for the CPU side of pre/postprocess. parallelFor hands
+// out indices one by one, the calling thread takes part and returns once every
+// index is done. Callers write into per-index slots, so results keep their order.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int  size() const { return static_cast<int>(m_workers.size()) + 1; }
+    void parallelFor(int count, const std::function<void(int)>& fn);
+
+private:
+    void workerLoop();
+    void runJob(const std::function<void(int)>& fn, int count);
+
+private:
+    std::vector<std::thread>        m_workers;
+    std::mutex                      m_mutex;
+    std::condition_variable         m_wake;
+    std::condition_variable         m_done;
+    std::mutex                      m_submit;   // one parallelFor at a time
+
+    const std::function<void(int)>* m_fn        = nullptr;
+    int                             m_count     = 0;
+    std::atomic<int>                m_next{0};
+    int                             m_active    = 0;    // workers inside the current job
+    unsigned                        m_job       = 0;    // bumped for every parallelFor
+    bool                            m_stop      = false;
+};
+
+}; // namespace threadpool
+
+#endif //__THREADPOOL_HPP__
@@ -15,16 +15,35 @@ struct ResizePadInfo {
     float       scale;
     int         padTop;
     int         padLeft;
+    cv::Rect    valid;      // resized content inside img, padding excluded
 };
 
 bool fileExists(const std::string fileName);
 bool ensure_dir(const std::string &dir);
 std::string getFileName(std::string filePath);
+std::vector<unsigned char> loadFile(const std::string &file);
 std::vector<float> toCHWFloat(cv::Mat &src, const float *meanVals, const float *normVals);
 void toCHWFloat(const cv::Mat& src, float* dst, const float* meanVals, const float* stdVals);
 void toCHWFloat(const cv::Mat& src, float* dst, const float* meanVals, const float* stdVals, const float scale);
+cv::Mat cropQuad(const cv::Mat& src, const cv::Point2f* quad, float width, float height, int interp);
+void warpQuadToCHW(const cv::Mat& src, const cv::Point2f* quad, float quadW, float quadH,
+                   int dstW, int dstH, int padW, float* dst,
+                   const float* meanVals, const float* stdVals, const float scale, bool rotate);
+cv::Mat grayThumb(const cv::Mat& src, const cv::Point2f* quad, float width, float height, int thumbHeight);
+void cropContrastInk(const cv::Mat& gray, float& contrast, float& ink);
+void subQuad(const cv::Point2f* quad, float quadW, float quadH, float x0, float x1, cv::Point2f* out);
 ResizePadInfo resizeAndPad(const cv::Mat& src, int targetH, int targetW, cv::Scalar paddValue = cv::Scalar(255, 255, 255));
+ResizePadInfo resizeLong(const cv::Mat& src, int limitSide, int align = 32, cv::Scalar paddValue = cv::Scalar(255, 255, 255));
 cv::Mat drawBoxes(const cv::Mat& src,const std::vector<std::vector<cv::Point2f>>& boxes);
+void binarizeMap(const cv::Mat& prob, cv::Mat& bitmap, float thresh);
+int argmaxRow(const float* src, int count, float* maxVal);
+void ctcGreedyDecode(const float* probs, int steps, int classes,
+                     std::vector<int>& chars, std::vector<int>& charSteps, std::vector<float>& charScores);
+float polygonMeanScore(const cv::Mat& prob, const cv::Point2f* pts, int count);
+bool belowMinSide(int dx, int dy, float minSide);
+void selectContours(const std::vector<std::vector<cv::Point>>& contours, int maxCount, float minSide,
+                    std::vector<std::vector<cv::Point2f>>& selected);
+bool unclipRect(const cv::Point2f* box, float unClipRatio, cv::Point2f* out);
 
 template<typename T>
 T getFkyamlValue(const fkyaml::node& n, const std::string& key, T defVal) {
@@ -1,3 +1,5 @@
+#include <cmath>
+#include <chrono>
 #include <string>
 #include <numeric>
 #include <fstream>
@@ -7,6 +9,7 @@
 #include "utils.hpp" 
 #include "logger.hpp"
 #include "fkyaml.hpp"
+#include "configcache.hpp"
 #include "anglecls.hpp"
 
 using namespace std;
@@ -16,36 +19,52 @@ namespace model{
 namespace anglecls {
 
 Anglecls::Anglecls(ModelParams &params, logger::Level level) : Model(params, level) {
+    m_fillPool.reset(new threadpool::ThreadPool(2));
 
-    std::ifstream ifs(params.inferYaml.c_str());
-    if (!ifs.is_open()) {
+    configcache::ConfigCache config(params.inferYaml);
+    if (!config.opened()) {
         LOGE("Failed to open infer yaml: %s", params.inferYaml.c_str());
         return;
     }
 
+    config.bind("width",    &m_dstWidth);
+    config.bind("height",   &m_dstHeight);
+    config.bind("channels", &m_channels);
+    config.bind("scale",    &m_scale);
+    config.bind("mean",     m_meanValues, 3);
+    config.bind("std",      m_normValues, 3);
+    if (!config.load()) {
+        if (!parseYaml(config.yaml())) return;
+        if (!config.save()) {
+            LOGW("Failed to write config cache %s.bin", params.inferYaml.c_str());
+        }
+    }
+}
+
+bool Anglecls::parseYaml(const std::string& yaml) {
     fkyaml::node root;
     try {
-        root = fkyaml::node::deserialize(ifs);
+        root = fkyaml::node::deserialize(yaml.begin(), yaml.end());
     } catch (const std::exception &e) {
         LOGE("Failed to parse yaml: %s", e.what());
-        return;
+        return false;
     }
 
     if (!root.contains("PreProcess")) {
         LOGE("PreProcess not found in yaml");
-        return;
+        return false;
     }
 
     fkyaml::node preprocess = root["PreProcess"];
     if (!preprocess.contains("transform_ops")) {
         LOGE("transform_ops not found in PreProcess");
-        return;
+        return false;
     }
 
     fkyaml::node ops = preprocess["transform_ops"];
     if (!ops.is_sequence()) {
         LOGE("transform_ops is not a sequence");
-        return;
+        return false;
     }
 
     bool foundNormalize = false;
@@ -121,14 +140,186 @@ Anglecls::Anglecls(ModelParams &params, logger::Level level) : Model(params, lev
     if (!foundNormalize) {
         LOGW("NormalizeImage not found, using default mean/std and m_channels");
     }
+    return true;
+}
+
+// Lines of one page share an orientation, their routes only differ by the
+// direction det ordered the quad corners in. A sample of the widest lines along
+// the dominant axis votes on the page route, the other lines along that axis
+// take it (flipped where the quad runs the opposite way) and only lines across
+// it, or all lines when the vote is split, are classified one by one.
+void Anglecls::inference(InferContext& ctx, std::string imagePath) {
+    int num = static_cast<int>(ctx.roiQuads.size());
+    ctx.pageAngle = -1;
+    if (num == 0 && ctx.roiMats.empty()) {
+        // a single image classified as a whole
+        Model::inference(ctx, imagePath);
+        ctx.angleFallback = static_cast<int>(ctx.roiRoutes.size());
+        return;
+    }
+    ctx.imagePath = imagePath;
+    if (!m_params->anglePageVote || m_params->anglePageSample < 1 || num <= m_params->anglePageSample) {
+        classify(ctx);
+        ctx.angleFallback = static_cast<int>(ctx.roiRoutes.size());
+        return;
+    }
+
+    // reading direction of every quad: 0 right, 1 down, 2 left, 3 up
+    std::vector<int> quadrant(num);
+    int counts[4] = {0, 0, 0, 0};
+    for (int i = 0; i < num; ++i) {
+        cv::Point2f d = ctx.roiQuads[i].pts[1] - ctx.roiQuads[i].pts[0];
+        int q = static_cast<int>(std::lround(std::atan2(d.y, d.x) / (CV_PI / 2)));
+        quadrant[i] = (q % 4 + 4) % 4;
+        counts[quadrant[i]]++;
+    }
+    int page_q = static_cast<int>(std::max_element(counts, counts + 4) - counts);
+
+    std::vector<int> axis;
+    for (int i = 0; i < num; ++i) {
+        if (quadrant[i] % 2 == page_q % 2) axis.push_back(i);
+    }
+    std::stable_sort(axis.begin(), axis.end(), [&](int a, int b) {
+        return ctx.roiQuads[a].width > ctx.roiQuads[b].width;
+    });
+    int sample = std::min(m_params->anglePageSample, static_cast<int>(axis.size()));
+
+    auto classify = [&](const std::vector<int>& lines, std::vector<int>& routes) {
+        InferContext sub;
+        sub.srcMat = ctx.srcMat;
+        for (int i : lines) {
+            sub.roiQuads.push_back(ctx.roiQuads[i]);
+            if (!ctx.roiMats.empty()) sub.roiMats.push_back(ctx.roiMats[i]);
+        }
+        classify(sub);
+        ctx.preTime   += sub.preTime;
+        ctx.inferTime += sub.inferTime;
+        ctx.postTime  += sub.postTime;
+        routes = std::move(sub.roiRoutes);
+    };
+
+    ctx.preTime = ctx.inferTime = ctx.postTime = 0.0;
+    ctx.roiRoutes.assign(num, 0);
+    std::vector<char> done(num, 0);
+    std::vector<int> picked(axis.begin(), axis.begin() + sample);
+    std::vector<int> routes;
+    classify(picked, routes);
+
+    int votes[2] = {0, 0};
+    for (int k = 0; k < sample && k < static_cast<int>(routes.size()); ++k) {
+        int i = picked[k];
+        ctx.roiRoutes[i] = routes[k];
+        done[i] = 1;
+        votes[(routes[k] != 0) != (quadrant[i] != page_q)]++;
+    }
+    int page_route = votes[1] > votes[0] ? 1 : 0;
+    // an empty sample agrees on nothing
+    bool agreed = sample > 0 && votes[page_route] >= m_params->anglePageAgree * sample;
+
+    std::vector<int> rest;
+    for (int i = 0; i < num; ++i) {
+        if (done[i]) continue;
+        if (agreed && quadrant[i] % 2 == page_q % 2) {
+            ctx.roiRoutes[i] = page_route ^ (quadrant[i] != page_q ? 1 : 0);
+        } else {
+            rest.push_back(i);
+        }
+    }
+    if (!rest.empty()) {
+        classify(rest, routes);
+        for (size_t k = 0; k < rest.size() && k < routes.size(); ++k) {
+            ctx.roiRoutes[rest[k]] = routes[k];
+        }
+    }
+
+    if (agreed) ctx.pageAngle = (page_q * 90 + page_route * 180) % 360;
+    ctx.angleFallback = static_cast<int>(rest.size());
+    LOGV("Page angle %d, sample %d, fallback %d", ctx.pageAngle, sample, ctx.angleFallback);
 }
 
 void Anglecls::setup(void const* data, size_t size) {
     LOG("Anglecls model setup success!!");
 }
 
+// Crops [first, first + count) at the classifier size into dst, quads are
+// sampled straight from the source image
+void Anglecls::fillChunk(const InferContext& ctx, int first, int count, float* dst) {
+    bool fused = ctx.roiMats.empty();
+    size_t single_size = m_channels * m_dstHeight * m_dstWidth;
+    for (int i = 0; i < count; ++i) {
+        float* dst_ptr = dst + i * single_size;
+        if (fused) {
+            const RoiQuad& quad = ctx.roiQuads[first + i];
+            warpQuadToCHW(ctx.srcMat, quad.pts, quad.width, quad.height,
+                          m_dstWidth, m_dstHeight, m_dstWidth, dst_ptr,
+                          m_meanValues, m_normValues, m_scale, false);
+        } else {
+            cv::Mat resize_mat;
+            cv::resize(ctx.roiMats[first + i], resize_mat, cv::Size(m_dstWidth, m_dstHeight));
+            toCHWFloat(resize_mat, dst_ptr, m_meanValues, m_normValues, m_scale);
+        }
+    }
+}
+
+// Runs the crops in micro-batches of angleBatchSize through two reused input
+// buffers, the next batch is filled on the pool worker while the current one
+// runs, so memory stays at two batches whatever the line count.
+void Anglecls::classify(InferContext& ctx) {
+    int total = static_cast<int>(ctx.roiMats.empty() ? ctx.roiQuads.size() : ctx.roiMats.size());
+    int chunk = std::max(1, std::min(m_params->angleBatchSize, total));
+    auto shapeOf = [&](int first) {
+        return std::vector<int64_t>{std::min(chunk, total - first), m_channels, m_dstHeight, m_dstWidth};
+    };
+
+    std::vector<int> routes;
+    routes.reserve(total);
+
+    auto fill = [&](int first, float* dst) {
+        auto start = std::chrono::steady_clock::now();
+        fillChunk(ctx, first, std::min(chunk, total - first), dst);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    double pre_time = total > 0 ? fill(0, reserveInput(shapeOf(0), m_chunks[0], 0)) : 0.0;
+    double infer_time = 0.0;
+    double post_time = 0.0;
+    for (int first = 0, k = 0; first < total; first += chunk, ++k) {
+        bool has_next = first + chunk < total;
+        float* next_input = nullptr;
+        if (has_next) {
+            next_input = reserveInput(shapeOf(first + chunk), m_chunks[(k + 1) % 2], (k + 1) % 2);
+        }
+
+        // the input filled last round, same buffer for the same shape and slot
+        inputBuffer(ctx, shapeOf(first), m_chunks[k % 2], k % 2);
+
+        // job 0 runs the current batch, job 1 fills the next one alongside
+        double fill_time = 0.0;
+        m_fillPool->parallelFor(has_next ? 2 : 1, [&](int job) {
+            if (job == 1) {
+                fill_time = fill(first + chunk, next_input);
+                return;
+            }
+            enqueueBindings(ctx);
+            postProcessCpu(ctx);
+        });
+        pre_time   += fill_time;
+        infer_time += ctx.inferTime;
+        post_time  += ctx.postTime;
+        routes.insert(routes.end(), ctx.roiRoutes.begin(), ctx.roiRoutes.end());
+        ctx.outputTensor.clear();
+    }
+    ctx.inputTensor = Ort::Value(nullptr);
+    ctx.binding = nullptr;
+    ctx.roiRoutes = std::move(routes);
+    ctx.preTime   = pre_time;
+    ctx.inferTime = infer_time;
+    ctx.postTime  = post_time;
+}
+
 bool Anglecls::preProcessCpu(InferContext& ctx) {
-    if(ctx.roiMats.empty()){
+    bool fused = ctx.roiMats.empty() && !ctx.roiQuads.empty();
+    if(ctx.roiMats.empty() && !fused){
         ctx.srcMat =cv::imread(ctx.imagePath);
         if (ctx.srcMat.data == nullptr) {
             LOGE("ERROR: Image file not founded! Program terminated"); 
@@ -138,35 +329,10 @@ bool Anglecls::preProcessCpu(InferContext& ctx) {
     }
 
     m_timer->startCpu();
-    int batch = static_cast<int>(ctx.roiMats.size());
+    int batch = static_cast<int>(fused ? ctx.roiQuads.size() : ctx.roiMats.size());
 
-    ctx.inputValues.clear();
-    ctx.inputShape.clear();
-    size_t single_size = m_channels * m_dstHeight * m_dstWidth;
-    ctx.inputValues.resize(batch*single_size);
-    int index = 0;
-    for(auto &src_mat : ctx.roiMats){
-        cv::Mat resize_mat;
-        cv::resize(src_mat, resize_mat, cv::Size(m_dstWidth, m_dstHeight));
-        float* dst_ptr = ctx.inputValues.data() + index * single_size;
-        toCHWFloat(resize_mat, dst_ptr, m_meanValues, m_normValues, m_scale);
-        index++;
-    }
-
-    ctx.inputShape = {batch, m_channels, m_dstHeight, m_dstWidth};
-
-    switch(m_params->inferBackend){
-        case common::infer_backend::ORT_CUDA:
-        case common::infer_backend::ORT_CPU:{
-            auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
-            ctx.inputTensor = Ort::Value::CreateTensor<float>(mem_info, 
-                ctx.inputValues.data(), 
-                ctx.inputValues.size(), 
-                ctx.inputShape.data(), 
-                ctx.inputShape.size());
-            break;
-        }
-    }
+    float* input = inputBuffer(ctx, {batch, m_channels, m_dstHeight, m_dstWidth}, ctx.inputValues);
+    fillChunk(ctx, 0, batch, input);
 
     m_timer->stopCpu();
     ctx.preTime = m_timer->durationCpu<timer::Timer::ms>("Anglecls preprocess(CPU)");
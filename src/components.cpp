@@ -0,0 +1,177 @@
+#include <algorithm>
+
+#include "opencv2/core.hpp"
+#include "components.hpp"
+
+namespace components{
+
+static int findRoot(std::vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+// roots always point to the smaller label, so a root precedes all its members
+static void unite(std::vector<int>& parent, int a, int b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a == b) return;
+    if (a < b) parent[b] = a;
+    else parent[a] = b;
+}
+
+static void mergeStats(Component& dst, const Component& src) {
+    dst.area     += src.area;
+    dst.xmin      = std::min(dst.xmin, src.xmin);
+    dst.ymin      = std::min(dst.ymin, src.ymin);
+    dst.xmax      = std::max(dst.xmax, src.xmax);
+    dst.ymax      = std::max(dst.ymax, src.ymax);
+    dst.scoreSum += src.scoreSum;
+}
+
+void RegionExtractor::labelStripe(Stripe& stripe, const cv::Mat& bitmap, const cv::Mat& prob) {
+    std::vector<int>& parent = stripe.parent;
+    std::vector<Component>& stats = stripe.stats;
+    parent.assign(1, 0);
+    stats.assign(1, Component{0, 0, 0, 0, 0, 0.0});
+
+    int cols = bitmap.cols;
+    for (int y = stripe.y0; y < stripe.y1; ++y) {
+        const uchar* b  = bitmap.ptr<uchar>(y);
+        const float* p  = prob.ptr<float>(y);
+        int*         l  = m_labels.ptr<int>(y);
+        // the row above belongs to another stripe at y0, it is stitched later
+        const int*   lu = y > stripe.y0 ? m_labels.ptr<int>(y - 1) : nullptr;
+
+        for (int x = 0; x < cols; ++x) {
+            if (!b[x]) {
+                l[x] = 0;
+                continue;
+            }
+
+            int lab = 0;
+            auto link = [&](int n) {
+                if (!n) return;
+                if (!lab) lab = n;
+                else if (n != lab) unite(parent, lab, n);
+            };
+            if (x > 0) link(l[x - 1]);
+            if (lu) {
+                if (x > 0) link(lu[x - 1]);
+                link(lu[x]);
+                if (x + 1 < cols) link(lu[x + 1]);
+            }
+
+            if (!lab) {
+                lab = static_cast<int>(parent.size());
+                parent.push_back(lab);
+                stats.push_back(Component{0, x, y, x, y, 0.0});
+            }
+            l[x] = lab;
+
+            Component& c = stats[lab];
+            c.area++;
+            c.xmin = std::min(c.xmin, x);
+            c.xmax = std::max(c.xmax, x);
+            c.ymax = y;
+            c.scoreSum += p[x];
+        }
+    }
+}
+
+void RegionExtractor::label(const cv::Mat& bitmap, const cv::Mat& prob, int stripes) {
+    CV_Assert(bitmap.type() == CV_8UC1 && prob.type() == CV_32FC1 && bitmap.size() == prob.size());
+    int rows = bitmap.rows;
+    int cols = bitmap.cols;
+
+    m_labels.create(rows, cols, CV_32SC1);
+    m_comps.clear();
+    if (rows == 0 || cols == 0) return;
+
+    // stripes of at least 16 rows, border stitching cost stays small
+    int n = std::max(1, std::min(stripes, rows / 16));
+    m_stripes.resize(n);
+    m_stripeOf.resize(rows);
+    for (int s = 0; s < n; ++s) {
+        m_stripes[s].y0 = rows * s / n;
+        m_stripes[s].y1 = rows * (s + 1) / n;
+        std::fill(m_stripeOf.begin() + m_stripes[s].y0, m_stripeOf.begin() + m_stripes[s].y1, s);
+    }
+
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int s = range.start; s < range.end; ++s) {
+            labelStripe(m_stripes[s], bitmap, prob);
+        }
+    });
+
+    // global label = stripe local label + stripe offset
+    int total = 0;
+    for (auto& stripe : m_stripes) {
+        stripe.offset = total;
+        total += static_cast<int>(stripe.parent.size()) - 1;
+    }
+
+    std::vector<int> parent(total + 1);
+    parent[0] = 0;
+    for (auto& stripe : m_stripes) {
+        for (size_t i = 1; i < stripe.parent.size(); ++i) {
+            parent[stripe.offset + i] = stripe.offset + stripe.parent[i];
+        }
+    }
+
+    // stitch each stripe's first row with the last row of the previous stripe
+    for (int s = 1; s < n; ++s) {
+        int y = m_stripes[s].y0;
+        const int* l  = m_labels.ptr<int>(y);
+        const int* lu = m_labels.ptr<int>(y - 1);
+        int off  = m_stripes[s].offset;
+        int offu = m_stripes[s - 1].offset;
+        for (int x = 0; x < cols; ++x) {
+            if (!l[x]) continue;
+            for (int nx = std::max(0, x - 1); nx <= std::min(cols - 1, x + 1); ++nx) {
+                if (lu[nx]) unite(parent, l[x] + off, lu[nx] + offu);
+            }
+        }
+    }
+
+    m_compOf.assign(total + 1, -1);
+    for (auto& stripe : m_stripes) {
+        for (size_t i = 1; i < stripe.parent.size(); ++i) {
+            int g = stripe.offset + static_cast<int>(i);
+            int r = findRoot(parent, g);
+            if (r == g) {
+                m_compOf[g] = static_cast<int>(m_comps.size());
+                m_comps.push_back(stripe.stats[i]);
+            } else {
+                m_compOf[g] = m_compOf[r];
+                mergeStats(m_comps[m_compOf[g]], stripe.stats[i]);
+            }
+        }
+    }
+}
+
+int RegionExtractor::componentAt(int x, int y) const {
+    int l = m_labels.at<int>(y, x);
+    if (!l) return -1;
+    return m_compOf[l + m_stripes[m_stripeOf[y]].offset];
+}
+
+void RegionExtractor::boundary(int index, std::vector<cv::Point2f>& points) const {
+    points.clear();
+    const Component& c = m_comps[index];
+    int rows = m_labels.rows;
+    int cols = m_labels.cols;
+    for (int y = c.ymin; y <= c.ymax; ++y) {
+        for (int x = c.xmin; x <= c.xmax; ++x) {
+            if (componentAt(x, y) != index) continue;
+            bool edge = x == 0 || y == 0 || x == cols - 1 || y == rows - 1
+                     || componentAt(x - 1, y) != index || componentAt(x + 1, y) != index
+                     || componentAt(x, y - 1) != index || componentAt(x, y + 1) != index;
+            if (edge) points.emplace_back(static_cast<float>(x), static_cast<float>(y));
+        }
+    }
+}
+
+}; // namespace components
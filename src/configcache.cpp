@@ -0,0 +1,249 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "configcache.hpp"
+
+namespace configcache{
+
+// file layout: Header | Scalar[scalarCount] | uint32 offsets[stringCount + 1] | blob
+static const char     CACHE_MAGIC[4] = {'O', 'C', 'R', 'C'};
+static const uint32_t CACHE_VERSION = 1;
+static const size_t   KEY_SIZE = 32;
+
+struct Header {
+    char        magic[4];
+    uint32_t    version;
+    uint64_t    yamlHash;
+    uint32_t    scalarCount;
+    uint32_t    stringCount;
+    uint64_t    blobSize;
+};
+
+struct Scalar {
+    char        key[KEY_SIZE];
+    double      value;
+};
+
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+CharTable::CharTable(CharTable&& other) {
+    *this = std::move(other);
+}
+
+CharTable& CharTable::operator=(CharTable&& other) {
+    m_ownBlob    = std::move(other.m_ownBlob);
+    m_ownOffsets = std::move(other.m_ownOffsets);
+    m_mapped     = other.m_mapped;
+    m_blob       = other.m_blob;
+    m_offsets    = other.m_offsets;
+    m_count      = other.m_count;
+    // a moved string may have had its chars inline, owned pointers are taken again
+    refresh();
+    other.m_ownBlob.clear();
+    other.m_ownOffsets.assign(1, 0);
+    other.m_mapped = false;
+    other.refresh();
+    return *this;
+}
+
+void CharTable::refresh() {
+    if (m_mapped) return;
+    m_blob    = m_ownBlob.data();
+    m_offsets = m_ownOffsets.data();
+    m_count   = static_cast<int>(m_ownOffsets.size()) - 1;
+}
+
+bool CharTable::equals(int i, const char* s, size_t n) const {
+    return length(i) == n && std::memcmp(data(i), s, n) == 0;
+}
+
+void CharTable::push_back(const char* s, size_t n) {
+    if (m_mapped) {
+        // copy the viewed entries before growing
+        m_ownBlob.assign(m_blob, m_offsets[m_count]);
+        m_ownOffsets.assign(m_offsets, m_offsets + m_count + 1);
+        m_mapped = false;
+    }
+    m_ownBlob.append(s, n);
+    m_ownOffsets.push_back(static_cast<uint32_t>(m_ownBlob.size()));
+    refresh();
+}
+
+void CharTable::view(const char* blob, const uint32_t* offsets, int count) {
+    m_ownBlob.clear();
+    m_ownOffsets.assign(1, 0);
+    m_mapped  = true;
+    m_blob    = blob;
+    m_offsets = offsets;
+    m_count   = count;
+}
+
+ConfigCache::ConfigCache(const std::string& yamlPath)
+    : m_yamlPath(yamlPath), m_cachePath(yamlPath + ".bin") {
+    std::ifstream ifs(yamlPath.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) return;
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    m_yaml   = oss.str();
+    m_hash   = fnv1a(m_yaml.data(), m_yaml.size());
+    m_opened = true;
+}
+
+ConfigCache::~ConfigCache() {
+    unmap();
+}
+
+void ConfigCache::unmap() {
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+        m_mapSize = 0;
+    }
+}
+
+void ConfigCache::bind(const char* key, float* values, int count) {
+    m_bindings.push_back(Binding{key, values, nullptr, count});
+}
+
+void ConfigCache::bind(const char* key, int* value) {
+    m_bindings.push_back(Binding{key, nullptr, value, 1});
+}
+
+void ConfigCache::bind(CharTable* table) {
+    m_table = table;
+}
+
+static std::string slotKey(const std::string& key, int count, int i) {
+    return count == 1 ? key : key + std::to_string(i);
+}
+
+bool ConfigCache::load() {
+    if (!m_opened) return false;
+    int fd = ::open(m_cachePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const char* base = static_cast<const char*>(map);
+    Header header;
+    std::memcpy(&header, base, sizeof(Header));
+    size_t scalars_size = header.scalarCount * sizeof(Scalar);
+    size_t offsets_size = (header.stringCount + 1) * sizeof(uint32_t);
+    bool valid = std::memcmp(header.magic, CACHE_MAGIC, 4) == 0
+              && header.version == CACHE_VERSION
+              && header.yamlHash == m_hash
+              && sizeof(Header) + scalars_size + offsets_size + header.blobSize == size;
+    if (!valid) {
+        munmap(map, size);
+        return false;
+    }
+
+    const Scalar* scalars = reinterpret_cast<const Scalar*>(base + sizeof(Header));
+    auto find = [&](const std::string& key, double& value) {
+        for (uint32_t s = 0; s < header.scalarCount; ++s) {
+            if (std::strncmp(scalars[s].key, key.c_str(), KEY_SIZE) == 0) {
+                value = scalars[s].value;
+                return true;
+            }
+        }
+        return false;
+    };
+    for (auto& b : m_bindings) {
+        for (int i = 0; i < b.count; ++i) {
+            double value;
+            if (!find(slotKey(b.key, b.count, i), value)) {
+                munmap(map, size);
+                return false;
+            }
+            if (b.floats) b.floats[i] = static_cast<float>(value);
+            else *b.ints = static_cast<int>(value);
+        }
+    }
+
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(base + sizeof(Header) + scalars_size);
+    const char* blob = reinterpret_cast<const char*>(offsets) + offsets_size;
+    if (m_table) {
+        if (header.stringCount == 0 || offsets[header.stringCount] != header.blobSize) {
+            munmap(map, size);
+            return false;
+        }
+        m_table->view(blob, offsets, static_cast<int>(header.stringCount));
+    }
+
+    unmap();
+    m_map = map;
+    m_mapSize = size;
+    releaseYaml();
+    return true;
+}
+
+void ConfigCache::releaseYaml() {
+    std::string().swap(m_yaml);
+}
+
+bool ConfigCache::save() {
+    if (!m_opened) return false;
+
+    std::vector<Scalar> scalars;
+    for (auto& b : m_bindings) {
+        for (int i = 0; i < b.count; ++i) {
+            Scalar s;
+            std::memset(s.key, 0, KEY_SIZE);
+            std::strncpy(s.key, slotKey(b.key, b.count, i).c_str(), KEY_SIZE - 1);
+            s.value = b.floats ? (double) b.floats[i] : (double) *b.ints;
+            scalars.push_back(s);
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version     = CACHE_VERSION;
+    header.yamlHash    = m_hash;
+    header.scalarCount = static_cast<uint32_t>(scalars.size());
+    header.stringCount = m_table ? static_cast<uint32_t>(m_table->size()) : 0;
+    header.blobSize    = m_table ? m_table->offsets()[m_table->size()] : 0;
+
+    // written under a temporary name first, a reader never maps half a file
+    std::string tmp_path = m_cachePath + ".tmp" + std::to_string(getpid());
+    std::ofstream ofs(tmp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) return false;
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    ofs.write(reinterpret_cast<const char*>(scalars.data()), scalars.size() * sizeof(Scalar));
+    uint32_t zero = 0;
+    if (m_table) {
+        ofs.write(reinterpret_cast<const char*>(m_table->offsets()), (m_table->size() + 1) * sizeof(uint32_t));
+        ofs.write(m_table->blob(), header.blobSize);
+    } else {
+        ofs.write(reinterpret_cast<const char*>(&zero), sizeof(uint32_t));
+    }
+    ofs.close();
+    releaseYaml();
+    if (!ofs || std::rename(tmp_path.c_str(), m_cachePath.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+}; // namespace configcache
@@ -1,12 +1,19 @@
 #include <memory>
+#include <chrono>
+#include <future>
 #include "creator.hpp"
 #include "logger.hpp"
 #include "detectioner.hpp"
 #include "recognizer.hpp"
 #include "anglecls.hpp"
+#include "utils.hpp"
 
 namespace ocrcreator{
 
+static double msSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
 Creator::Creator(std::vector<model::ModelParams> &paramList, logger::Level level) {
     m_logger = logger::createLogger(level);
 
@@ -29,74 +36,293 @@ Creator::Creator(std::vector<model::ModelParams> &paramList, logger::Level level
 }
 
 std::shared_ptr<model::InferResult> Creator::inference(const std::string &imagePath) {
+    auto start = std::chrono::steady_clock::now();
     auto rets = std::make_shared<model::InferResult>();
     model::InferContext det_ctx;
     if (m_detectioner) {
         m_detectioner->inference(det_ctx, imagePath);
-        rets->preTime   += det_ctx.preTime;
-        rets->inferTime += det_ctx.inferTime;
-        rets->postTime  += det_ctx.postTime;
+        collectDetection(det_ctx, *rets);
+    }
+
+    inferenceCrops(det_ctx, imagePath, *rets);
+    rets->wallTime = msSince(start);
+    return rets;
+}
+
+std::vector<std::shared_ptr<model::InferResult>> Creator::inference(const std::vector<std::string> &imagePaths) {
+    std::vector<std::shared_ptr<model::InferResult>> rets_list;
+    rets_list.reserve(imagePaths.size());
+
+    // pages are detected in batches, crops still run per page
+    std::vector<model::InferContext> det_ctxs(imagePaths.size());
+    auto det_start = std::chrono::steady_clock::now();
+    if (m_detectioner) {
+        m_detectioner->inferenceBatch(det_ctxs, imagePaths);
+    }
+    // the batched det wall time is shared evenly between the pages
+    double det_wall = msSince(det_start) / std::max<size_t>(1, imagePaths.size());
+
+    for (size_t i = 0; i < imagePaths.size(); ++i) {
+        auto start = std::chrono::steady_clock::now();
+        auto rets = std::make_shared<model::InferResult>();
+        if (det_ctxs[i].failed) {
+            // unreadable page, cls/rec would read nothing but an empty image
+            rets->failed = true;
+            rets_list.push_back(rets);
+            det_ctxs[i] = model::InferContext();
+            continue;
+        }
+        if (m_detectioner) {
+            collectDetection(det_ctxs[i], *rets);
+        }
+        inferenceCrops(det_ctxs[i], imagePaths[i], *rets);
+        rets->wallTime = det_wall + msSince(start);
+        rets_list.push_back(rets);
+
+        // release the page and its crops once the results are moved out
+        det_ctxs[i] = model::InferContext();
+    }
+    return rets_list;
+}
+
+void Creator::collectDetection(model::InferContext &det_ctx, model::InferResult &rets) {
+    rets.preTime   += det_ctx.preTime;
+    rets.inferTime += det_ctx.inferTime;
+    rets.postTime  += det_ctx.postTime;
+    rets.detPostArea = det_ctx.postArea;
+}
+
+void Creator::inferenceCrops(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets) {
+    int num_rois = static_cast<int>(det_ctx.roiQuads.size());
+    int rejected = 0;
+    for (int reason : det_ctx.roiGates) {
+        if (reason != common::CROP_KEPT) rejected++;
+    }
+
+    if (rejected == 0) {
+        readCrops(det_ctx, imagePath, rets);
+    } else {
+        // only the kept crops go through cls/rec, rejected boxes read as empty
+        model::InferContext kept_ctx;
+        kept_ctx.imagePath = imagePath;
+        kept_ctx.srcMat    = det_ctx.srcMat;
+        std::vector<int> kept;
+        for (int i = 0; i < num_rois; ++i) {
+            if (det_ctx.roiGates[i] != common::CROP_KEPT) continue;
+            kept.push_back(i);
+            kept_ctx.roiQuads.push_back(det_ctx.roiQuads[i]);
+            if (!det_ctx.roiMats.empty()) kept_ctx.roiMats.push_back(det_ctx.roiMats[i]);
+        }
+
+        model::InferResult kept_rets;
+        if (!kept.empty()) {
+            readCrops(kept_ctx, imagePath, kept_rets);
+        }
+
+        if (m_recognizer) {
+            rets.regRets.assign(num_rois, std::string());
+            rets.regScores.assign(num_rois, 0.f);
+            rets.regCharScores.assign(num_rois, std::vector<float>());
+        }
+        det_ctx.roiRoutes.assign(num_rois, 0);
+        for (size_t k = 0; k < kept.size(); ++k) {
+            int i = kept[k];
+            if (m_recognizer && k < kept_rets.regRets.size()) {
+                rets.regRets[i]       = std::move(kept_rets.regRets[k]);
+                rets.regScores[i]     = kept_rets.regScores[k];
+                rets.regCharScores[i] = std::move(kept_rets.regCharScores[k]);
+            }
+            if (k < kept_ctx.roiRoutes.size()) det_ctx.roiRoutes[i] = kept_ctx.roiRoutes[k];
+        }
+        rets.recLines     = kept_rets.recLines;
+        rets.recEscalated = kept_rets.recEscalated;
+        rets.recImproved  = kept_rets.recImproved;
+        rets.recRerun     = kept_rets.recRerun;
+        rets.pageAngle    = kept_rets.pageAngle;
+        rets.angleFallback = kept_rets.angleFallback;
+        rets.preTime   += kept_rets.preTime;
+        rets.inferTime += kept_rets.inferTime;
+        rets.postTime  += kept_rets.postTime;
+    }
+    rets.gateRets     = std::move(det_ctx.roiGates);
+    rets.gateRejected = rejected;
+
+    if (m_detectioner) {
+        rets.decBoxes = std::move(det_ctx.boxes);
+        rets.decQuads = std::move(det_ctx.roiQuads);
+        rets.decRets  = std::move(det_ctx.roiMats);
     }
 
     if (m_anglecls) {
+        rets.angleRets = std::move(det_ctx.roiRoutes);
+    }
+}
+
+void Creator::readCrops(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets) {
+    // with escalation the first pass skips the angle check and reads squeezed lines
+    bool escalate = m_recognizer && !det_ctx.roiQuads.empty()
+                 && m_recognizer->m_params->recEscalateThresh > 0.f;
+
+    // speculative lines are read upright while the angle cls runs on its own
+    // context, only the lines it flips are read again
+    bool speculate = m_anglecls && !escalate && m_recognizer && !det_ctx.roiQuads.empty()
+                  && m_recognizer->m_params->recSpeculate;
+    model::InferContext angle_ctx;
+    std::future<void> angle_job;
+    if (speculate) {
+        angle_ctx.srcMat   = det_ctx.srcMat;
+        angle_ctx.roiQuads = det_ctx.roiQuads;
+        angle_ctx.roiMats  = det_ctx.roiMats;
+        angle_job = std::async(std::launch::async, [&]() { m_anglecls->inference(angle_ctx, imagePath); });
+    } else if (m_anglecls && !escalate) {
         m_anglecls->inference(det_ctx, imagePath);
-        rets->preTime   += det_ctx.preTime;
-        rets->inferTime += det_ctx.inferTime;
-        rets->postTime  += det_ctx.postTime;
+        rets.preTime   += det_ctx.preTime;
+        rets.inferTime += det_ctx.inferTime;
+        rets.postTime  += det_ctx.postTime;
+        rets.pageAngle     = det_ctx.pageAngle;
+        rets.angleFallback = det_ctx.angleFallback;
     }
 
     if (m_recognizer) {
         model::InferContext rec_ctx;
         rec_ctx.imagePath = imagePath;
 
-        if (!det_ctx.roiMats.empty()) {
-            int num_rois = static_cast<int>(det_ctx.roiMats.size());
-            rets->regRets.reserve(num_rois);
-
-            for (int i = 0; i < num_rois; ++i) {
-                rec_ctx.roiMats.clear();
-                rec_ctx.roiMats.emplace_back(det_ctx.roiMats[i]);
-
-                rec_ctx.roiRoutes.clear();
-                rec_ctx.roiRoutes.emplace_back(det_ctx.roiRoutes[i]);
+        if (!det_ctx.roiQuads.empty()) {
+            // fused crops sample the det source image through each quad, the
+            // recognizer groups the lines into width buckets and keeps their order
+            int num_rois = static_cast<int>(det_ctx.roiQuads.size());
+            rec_ctx.srcMat = det_ctx.srcMat;
+            if (det_ctx.roiMats.empty()) {
+                rec_ctx.roiQuads = det_ctx.roiQuads;
+            } else {
+                rec_ctx.roiMats = det_ctx.roiMats;
+            }
+            if (!speculate) {
+                rec_ctx.roiRoutes = det_ctx.roiRoutes;
+            }
+            rec_ctx.roiRoutes.resize(num_rois, 0);
+            if (escalate) {
+                rec_ctx.recWidthScale = m_recognizer->m_params->recCheapScale;
+            }
 
-                m_recognizer->inference(rec_ctx, imagePath);
+            m_recognizer->inference(rec_ctx, imagePath);
+            rets.regRets       = std::move(rec_ctx.regResults);
+            rets.regScores     = std::move(rec_ctx.regScores);
+            rets.regCharScores = std::move(rec_ctx.regCharScores);
+            rets.recLines      = num_rois;
 
-                if (!rec_ctx.regResults.empty()) {
-                    rets->regRets.push_back(std::move(rec_ctx.regResults[0]));
-                }
+            rets.preTime   += rec_ctx.preTime;
+            rets.inferTime += rec_ctx.inferTime;
+            rets.postTime  += rec_ctx.postTime;
 
-                rets->preTime   += rec_ctx.preTime;
-                rets->inferTime += rec_ctx.inferTime;
-                rets->postTime  += rec_ctx.postTime;
+            if (speculate) {
+                angle_job.get();
+                det_ctx.roiRoutes = std::move(angle_ctx.roiRoutes);
+                rets.preTime   += angle_ctx.preTime;
+                rets.inferTime += angle_ctx.inferTime;
+                rets.postTime  += angle_ctx.postTime;
+                rets.pageAngle     = angle_ctx.pageAngle;
+                rets.angleFallback = angle_ctx.angleFallback;
+                rerunFlipped(det_ctx, imagePath, rets);
+            }
+            if (escalate) {
+                escalateLines(det_ctx, imagePath, rets);
             }
         } else {
             m_recognizer->inference(rec_ctx, imagePath);
-            rets->regRets = std::move(rec_ctx.regResults);
+            rets.regRets       = std::move(rec_ctx.regResults);
+            rets.regScores     = std::move(rec_ctx.regScores);
+            rets.regCharScores = std::move(rec_ctx.regCharScores);
 
-            rets->preTime   += rec_ctx.preTime;
-            rets->inferTime += rec_ctx.inferTime;
-            rets->postTime  += rec_ctx.postTime;
+            rets.preTime   += rec_ctx.preTime;
+            rets.inferTime += rec_ctx.inferTime;
+            rets.postTime  += rec_ctx.postTime;
         }
     }
+}
 
-    // Multi-batch accuracy drops and speed decreases; batch needs to be organized
-    // if (m_recognizer != nullptr) {
-    //     m_recognizer->inference(det_ctx, imagePath);
-    //     rets->preTime += dec_ctx.preTime;
-    //     rets->inferTime += det_ctx.inferTime;
-    //     rets->postTime += det_ctx.postTime;
-    // }
+// Lines the angle cls flipped after the speculative upright read are read again
+// rotated, their upright reads are dropped whatever the scores.
+void Creator::rerunFlipped(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets) {
+    std::vector<int> lines;
+    for (int i = 0; i < (int)det_ctx.roiRoutes.size() && i < (int)rets.regRets.size(); ++i) {
+        if (det_ctx.roiRoutes[i] != 0) lines.push_back(i);
+    }
+    rets.recRerun = static_cast<int>(lines.size());
+    if (lines.empty()) return;
 
-    if (m_detectioner) {
-        rets->decBoxes = std::move(det_ctx.boxes);
-        rets->decRets  = std::move(det_ctx.roiMats);
+    model::InferContext flip_ctx;
+    flip_ctx.imagePath = imagePath;
+    flip_ctx.srcMat = det_ctx.srcMat;
+    for (int i : lines) {
+        if (det_ctx.roiMats.empty()) flip_ctx.roiQuads.push_back(det_ctx.roiQuads[i]);
+        else flip_ctx.roiMats.push_back(det_ctx.roiMats[i]);
+        flip_ctx.roiRoutes.push_back(det_ctx.roiRoutes[i]);
+    }
+
+    m_recognizer->inference(flip_ctx, imagePath);
+    rets.preTime   += flip_ctx.preTime;
+    rets.inferTime += flip_ctx.inferTime;
+    rets.postTime  += flip_ctx.postTime;
+
+    for (size_t k = 0; k < lines.size() && k < flip_ctx.regResults.size(); ++k) {
+        int i = lines[k];
+        rets.regRets[i]       = std::move(flip_ctx.regResults[k]);
+        rets.regScores[i]     = flip_ctx.regScores[k];
+        rets.regCharScores[i] = std::move(flip_ctx.regCharScores[k]);
+    }
+}
+
+// Lines the first pass read below the confidence threshold get a bicubic crop,
+// the angle check and the full rec width. The more confident read is kept,
+// lines left alone keep route 0.
+void Creator::escalateLines(model::InferContext &det_ctx, const std::string &imagePath, model::InferResult &rets) {
+    float thresh = m_recognizer->m_params->recEscalateThresh;
+    std::vector<int> lines;
+    for (int i = 0; i < (int)rets.regScores.size(); ++i) {
+        if (rets.regScores[i] < thresh) lines.push_back(i);
+    }
+    det_ctx.roiRoutes.assign(det_ctx.roiQuads.size(), 0);
+    rets.recEscalated = static_cast<int>(lines.size());
+    if (lines.empty()) return;
+
+    model::InferContext hi_ctx;
+    hi_ctx.imagePath = imagePath;
+    hi_ctx.srcMat = det_ctx.srcMat;
+    hi_ctx.roiMats.reserve(lines.size());
+    for (int i : lines) {
+        const model::RoiQuad& quad = det_ctx.roiQuads[i];
+        hi_ctx.roiMats.emplace_back(cropQuad(det_ctx.srcMat, quad.pts, quad.width, quad.height, cv::INTER_CUBIC));
     }
 
     if (m_anglecls) {
-        rets->angleRets = std::move(det_ctx.roiRoutes);
+        m_anglecls->inference(hi_ctx, imagePath);
+        rets.preTime   += hi_ctx.preTime;
+        rets.inferTime += hi_ctx.inferTime;
+        rets.postTime  += hi_ctx.postTime;
     }
-    return rets;
+    hi_ctx.roiRoutes.resize(lines.size(), 0);
+
+    m_recognizer->inference(hi_ctx, imagePath);
+    rets.preTime   += hi_ctx.preTime;
+    rets.inferTime += hi_ctx.inferTime;
+    rets.postTime  += hi_ctx.postTime;
+
+    for (size_t k = 0; k < lines.size() && k < hi_ctx.regResults.size(); ++k) {
+        int i = lines[k];
+        det_ctx.roiRoutes[i] = hi_ctx.roiRoutes[k];
+        if (hi_ctx.regScores[k] > rets.regScores[i]) {
+            rets.regRets[i]       = std::move(hi_ctx.regResults[k]);
+            rets.regScores[i]     = hi_ctx.regScores[k];
+            rets.regCharScores[i] = std::move(hi_ctx.regCharScores[k]);
+            rets.recImproved++;
+        }
+    }
+}
+
+int Creator::recClasses() const {
+    if (!m_recognizer) return 0;
+    return std::static_pointer_cast<model::recognizer::Recognizer>(m_recognizer)->classes();
 }
 
 std::shared_ptr<Creator> createCreator(std::vector<model::ModelParams> &paramList, logger::Level level) 
@@ -14,6 +14,7 @@
 #include "detectioner.hpp"
 #include "clipper.hpp"
 #include "fkyaml.hpp"
+#include "configcache.hpp"
 
 using namespace std;
 
@@ -23,29 +24,47 @@ namespace detectioner {
 
 Detectioner::Detectioner(ModelParams &params, logger::Level level, float minSide) : Model(params, level), m_minSide(minSide) {
 
-    std::ifstream ifs(params.inferYaml.c_str());
-    if (!ifs.is_open()) {
+    m_pool.reset(new threadpool::ThreadPool(params.postThreadnum));
+
+    configcache::ConfigCache config(params.inferYaml);
+    if (!config.opened()) {
         LOGE("Failed to open infer yaml: %s", params.inferYaml.c_str());
         return;
     }
 
+    config.bind("thresh",         &m_textThresh);
+    config.bind("box_thresh",     &m_scoreThresh);
+    config.bind("max_candidates", &m_maxCandidates);
+    config.bind("unclip_ratio",   &m_unClipRatio);
+    config.bind("resize_long",    &m_limitSideLen);
+    config.bind("mean",           m_meanValues, 3);
+    config.bind("std",            m_normValues, 3);
+    if (!config.load()) {
+        if (!parseYaml(config.yaml())) return;
+        if (!config.save()) {
+            LOGW("Failed to write config cache %s.bin", params.inferYaml.c_str());
+        }
+    }
+}
+
+bool Detectioner::parseYaml(const std::string& yaml) {
     fkyaml::node root;
     try {
-        root = fkyaml::node::deserialize(ifs);
+        root = fkyaml::node::deserialize(yaml.begin(), yaml.end());
     } catch (const std::exception& e) {
         LOGE("Failed to parse yaml: %s", e.what());
-        return;
+        return false;
     }
 
     if (!root.contains("PostProcess")) {
         LOGE("PostProcess not found in yaml");
-        return;
+        return false;
     }
 
     fkyaml::node post = root["PostProcess"];
     if (!post.is_mapping()) {
         LOGE("PostProcess is not a map");
-        return;
+        return false;
     }
 
     m_textThresh    = getFkyamlValue(post, "thresh",         0.3f);
@@ -55,25 +74,41 @@ Detectioner::Detectioner(ModelParams &params, logger::Level level, float minSide
 
     if (!root.contains("PreProcess")) {
         LOGE("PreProcess not found in yaml");
-        return;
+        return false;
     }
 
     fkyaml::node preprocess = root["PreProcess"];
     if (!preprocess.contains("transform_ops")) {
         LOGE("transform_ops not found in PreProcess");
-        return;
+        return false;
     }
 
     fkyaml::node ops = preprocess["transform_ops"];
     if (!ops.is_sequence()) {
         LOGE("transform_ops is not a sequence");
-        return;
+        return false;
     }
 
     bool foundNormalize = false;
+    bool foundResize = false;
 
     for (const auto& op : ops) {
-        if (!op.is_mapping() || !op.contains("NormalizeImage")) {
+        if (!op.is_mapping()) {
+            continue;
+        }
+
+        if (!foundResize && op.contains("DetResizeForTest")) {
+            fkyaml::node resize = op["DetResizeForTest"];
+            if (resize.is_mapping()) {
+                m_limitSideLen = getFkyamlValue(resize, "resize_long", m_limitSideLen);
+                foundResize = true;
+            } else {
+                LOGW("DetResizeForTest is not a map");
+            }
+            continue;
+        }
+
+        if (foundNormalize || !op.contains("NormalizeImage")) {
             continue;
         }
 
@@ -109,12 +144,15 @@ Detectioner::Detectioner(ModelParams &params, logger::Level level, float minSide
         m_normValues[0] = std[2].get_value<float>();
 
         foundNormalize = true;
-        break;
     }
 
     if (!foundNormalize) {
         LOGW("NormalizeImage not found, using default mean/std");
     }
+    if (!foundResize) {
+        LOGW("DetResizeForTest not found, using resize_long=%d", m_limitSideLen);
+    }
+    return true;
 }
 
 void Detectioner::setup(void const* data, size_t size) {
@@ -132,35 +170,27 @@ bool Detectioner::preProcessCpu(InferContext& ctx) {
     }
 
     m_timer->startCpu();
-    // BGR2RGB
-    cv::Mat rgb_img;
-    cvtColor(ctx.srcMat, rgb_img, cv::COLOR_BGR2RGB);
-
-    // Padding
-    auto pad_info = resizeAndPad(rgb_img, m_params->img.h, m_params->img.w);
+    // Padding: fixed letterbox, or long side to limit with 32-aligned dynamic shape
+    ResizePadInfo pad_info;
+    if (m_params->detResize == common::det_resize_mode::RESIZE_LONG) {
+        pad_info = resizeLong(ctx.srcMat, m_limitSideLen);
+    } else {
+        pad_info = resizeAndPad(ctx.srcMat, m_params->img.h, m_params->img.w);
+    }
     cv::Mat dst_img = pad_info.img;
+    if (!dst_img.isContinuous()) {
+        dst_img = dst_img.clone();
+    }
     m_scale   = pad_info.scale;
     m_padTop  = pad_info.padTop;
     m_padLeft = pad_info.padLeft;
+    m_validRect = pad_info.valid;
     m_srcWidth = ctx.srcMat.cols;
     m_srcHeight = ctx.srcMat.rows;
 
-    // Normalize and to tensor(bchw)
-    ctx.inputValues = toCHWFloat(dst_img, m_meanValues, m_normValues);
-    ctx.inputShape = {1, dst_img.channels(), dst_img.rows, dst_img.cols};
-
-    switch(m_params->inferBackend){
-        case common::infer_backend::ORT_CUDA:
-        case common::infer_backend::ORT_CPU:{
-            auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
-            ctx.inputTensor = Ort::Value::CreateTensor<float>(mem_info, 
-                ctx.inputValues.data(), 
-                ctx.inputValues.size(), 
-                ctx.inputShape.data(), 
-                ctx.inputShape.size());
-            break;
-        }
-    }
+    // BGR -> RGB + normalize + CHW, written into the input of the next run
+    float* input = inputBuffer(ctx, {1, dst_img.channels(), dst_img.rows, dst_img.cols}, ctx.inputValues);
+    toCHWFloat(dst_img, input, m_meanValues, m_normValues);
 
     m_timer->stopCpu();
     ctx.preTime = m_timer->durationCpu<timer::Timer::ms>("Detectioner preprocess(CPU)");
@@ -208,47 +238,21 @@ Detectioner::getMiniBoxes(const std::vector<cv::Point2f> &contour) {
 float Detectioner::getScoreFast(const cv::Mat &bitmap,
                                 const std::vector<cv::Point2f> &contour) {
     if (contour.empty()) return 0.0f;
-
-    int h = bitmap.size[bitmap.dims - 2];
-    int w = bitmap.size[bitmap.dims - 1];
-
-    float xmin_f = contour[0].x, xmax_f = contour[0].x;
-    float ymin_f = contour[0].y, ymax_f = contour[0].y;
-
-    for (const auto &pt : contour) {
-        if (pt.x < xmin_f) xmin_f = pt.x;
-        if (pt.x > xmax_f) xmax_f = pt.x;
-        if (pt.y < ymin_f) ymin_f = pt.y;
-        if (pt.y > ymax_f) ymax_f = pt.y;
-    }
-
-    int xmin = std::max(0, static_cast<int>(std::floor(xmin_f)));
-    int xmax = std::min(w - 1, static_cast<int>(std::ceil(xmax_f)));
-    int ymin = std::max(0, static_cast<int>(std::floor(ymin_f)));
-    int ymax = std::min(h - 1, static_cast<int>(std::ceil(ymax_f)));
-
-    if (xmax <= xmin || ymax <= ymin) return 0.0f;
-
-    cv::Mat mask = cv::Mat::zeros(ymax - ymin + 1, xmax - xmin + 1, CV_8UC1);
-    std::vector<cv::Point> contour_int;
-    contour_int.reserve(contour.size());
-
-    for (const auto &pt : contour) {
-        int x = cvRound(pt.x - xmin);
-        int y = cvRound(pt.y - ymin);
-        contour_int.emplace_back(x, y);
-    }
-
-    cv::fillPoly(mask, std::vector<std::vector<cv::Point>>{contour_int}, cv::Scalar(1));
-    cv::Mat roi = bitmap(cv::Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1));
-    cv::Scalar mean_val = cv::mean(roi, mask);
-
-    return static_cast<float>(mean_val[0]);
+    return polygonMeanScore(bitmap, contour.data(), static_cast<int>(contour.size()));
 }
 
 std::vector<cv::Point2f>
 Detectioner::unClip(const std::vector<cv::Point2f> &box, float unClipRatio) {
     std::vector<cv::Point2f> result;
+    // boxes from getMiniBoxes are rectangles, Clipper only handles degenerate ones
+    if (m_params->fastUnclip && box.size() == 4) {
+        result.resize(4);
+        if (unclipRect(box.data(), unClipRatio, result.data())) {
+            return result;
+        }
+        result.clear();
+    }
+
     float area = cv::contourArea(box);
     float length = cv::arcLength(box, true);
     float distance = area * unClipRatio / length;
@@ -289,70 +293,246 @@ static void orderPoints(const std::vector<cv::Point2f>& pts, cv::Point2f ordered
     ordered[0] = tl; ordered[1] = tr; ordered[2] = br; ordered[3] = bl;
 }
 
-bool Detectioner::postProcessCpu(InferContext& ctx) {
-    m_timer->startCpu();
-    assert(!ctx.outputTensor.empty());
+void Detectioner::findComponents(const cv::Mat& probMap, std::vector<std::vector<cv::Point2f>>& contours) {
+    m_extractor.label(m_bitMap, probMap, cv::getNumThreads());
+    const auto& comps = m_extractor.components();
+
+    std::vector<int> survivors;
+    survivors.reserve(comps.size());
+    for (int i = 0; i < (int)comps.size(); ++i) {
+        const auto& c = comps[i];
+        if (belowMinSide(c.xmax - c.xmin, c.ymax - c.ymin, m_minSide)) continue;
+        // heuristic prefilter on the component's own mean score: the min-area box
+        // scored later may also cover strong neighbours and pass where this
+        // fails, so a weak component next to other text can be dropped here
+        // while the contour path keeps it
+        if (c.scoreSum < m_scoreThresh * c.area) continue;
+        survivors.push_back(i);
+    }
 
-    float* float_array = ctx.outputTensor[0].GetTensorMutableData<float>();
-    cv::Mat out_mat(m_params->img.h, m_params->img.w, CV_32FC1, float_array);
+    int keep = std::min((int)survivors.size(), m_maxCandidates);
+    std::partial_sort(survivors.begin(), survivors.begin() + keep, survivors.end(),
+                      [&](int a, int b) { return comps[a].area > comps[b].area; });
+    survivors.resize(keep);
+
+    contours.resize(survivors.size());
+    for (size_t i = 0; i < survivors.size(); ++i) {
+        m_extractor.boundary(survivors[i], contours[i]);
+    }
+}
 
-    cv::Mat bit_mat;
-    cv::threshold(out_mat, bit_mat, m_textThresh, 255, cv::THRESH_BINARY);
-    bit_mat.convertTo(bit_mat, CV_8UC1);
+void Detectioner::extractBoxes(const cv::Mat& probMap, const DetTransform& trans,
+                               const cv::Size& srcSize, std::vector<BoxWithCoord>& boxes) {
+    // padding never holds text, only the content region is thresholded/scored
+    cv::Rect map_rect(0, 0, probMap.cols, probMap.rows);
+    cv::Rect valid = trans.valid.empty() ? map_rect : (trans.valid & map_rect);
+    if (valid.empty()) return;
+    cv::Mat valid_map = probMap(valid);
 
-    std::vector<std::vector<cv::Point>> contours_i;
-    cv::findContours(bit_mat, contours_i, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+    binarizeMap(valid_map, m_bitMap, m_textThresh);
 
     std::vector<std::vector<cv::Point2f>> contours;
-    for (auto& c : contours_i) {
-        std::vector<cv::Point2f> cf;
-        for (auto& p : c) cf.emplace_back(p.x, p.y);
-        contours.push_back(cf);
+    if (m_params->detRegion == common::det_region_mode::COMPONENTS) {
+        findComponents(valid_map, contours);
+    } else {
+        std::vector<std::vector<cv::Point>> contours_i;
+        cv::findContours(m_bitMap, contours_i, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+        selectContours(contours_i, m_maxCandidates, m_minSide, contours);
     }
 
-    std::sort(contours.begin(), contours.end(),
-              [](const std::vector<cv::Point2f>& a, const std::vector<cv::Point2f>& b) {
-                  return cv::contourArea(a) > cv::contourArea(b);
-              });
-
     int num = std::min((int)contours.size(), m_maxCandidates);
-    std::vector<BoxWithCoord> valid_boxes;
 
-    for (int i = 0; i < num; i++) {
+    // candidates are independent, each one fills its own slot
+    std::vector<BoxWithCoord> slots(num);
+    std::vector<char> kept(num, 0);
+    m_pool->parallelFor(num, [&](int i) {
         // find mini boxs
         auto box_ret = getMiniBoxes(contours[i]);
-        if (box_ret.second < m_minSide) continue;
+        if (box_ret.second < m_minSide) return;
 
         // find rect
-        float score = getScoreFast(out_mat, box_ret.first);
-        if (score < m_scoreThresh) continue;
+        float score = getScoreFast(valid_map, box_ret.first);
+        if (score < m_scoreThresh) return;
 
         auto unclip = unClip(box_ret.first, m_unClipRatio);
-        if (unclip.size() < 4) continue;
+        if (unclip.size() < 4) return;
 
         auto minbox = getMiniBoxes(unclip);
-        if (minbox.second < m_minSide) continue;
+        if (minbox.second < m_minSide) return;
 
+        // map to source image
         for (auto& p : minbox.first) {
-            p.x = (p.x - m_padLeft) / m_scale;
-            p.y = (p.y - m_padTop) / m_scale;
-            p.x = std::max(0.f, std::min(p.x, (float)ctx.srcMat.cols - 1));
-            p.y = std::max(0.f, std::min(p.y, (float)ctx.srcMat.rows - 1));
+            p.x = (p.x + valid.x - trans.padLeft) / trans.scale + trans.offset.x;
+            p.y = (p.y + valid.y - trans.padTop) / trans.scale + trans.offset.y;
+            p.x = std::max(0.f, std::min(p.x, (float)srcSize.width - 1));
+            p.y = std::max(0.f, std::min(p.y, (float)srcSize.height - 1));
         }
 
         float top = std::min({minbox.first[0].y, minbox.first[1].y, minbox.first[2].y, minbox.first[3].y});
         float left = std::min({minbox.first[0].x, minbox.first[1].x, minbox.first[2].x, minbox.first[3].x});
-        valid_boxes.push_back({minbox.first, top, left});
+        slots[i] = {minbox.first, top, left};
+        kept[i]  = 1;
+    });
+
+    for (int i = 0; i < num; i++) {
+        if (kept[i]) boxes.push_back(std::move(slots[i]));
     }
+}
+
+// long axis of a box with corners in cycle order
+struct LineAxis {
+    cv::Point2f     center;
+    cv::Point2f     dir;        // unit vector along the long side
+    float           length;
+    float           height;
+};
+
+static LineAxis lineAxis(const std::vector<cv::Point2f>& box) {
+    cv::Point2f e0 = box[1] - box[0];
+    cv::Point2f e1 = box[3] - box[0];
+    float l0 = std::hypot(e0.x, e0.y);
+    float l1 = std::hypot(e1.x, e1.y);
+    LineAxis axis;
+    axis.center = (box[0] + box[1] + box[2] + box[3]) * 0.25f;
+    axis.length = std::max(l0, l1);
+    axis.height = std::min(l0, l1);
+    axis.dir    = l0 >= l1 ? e0 * (1.f / std::max(l0, 1e-6f)) : e1 * (1.f / std::max(l1, 1e-6f));
+    return axis;
+}
 
+// Two pieces of one line cut at a tile border: same height and direction, on
+// one baseline, and overlapping along the line over the tile overlap band. Long
+// pieces share only that band, so the area ratio alone never merges them.
+static bool sameLinePieces(const LineAxis& a, const LineAxis& b, int overlap) {
+    if (overlap <= 0) return false;
+    float min_h = std::min(a.height, b.height);
+    if (min_h < 0.7f * std::max(a.height, b.height)) return false;
+    if (std::fabs(a.dir.dot(b.dir)) < 0.985f) return false;                // ~10 degrees
+    cv::Point2f d = b.center - a.center;
+    if (std::fabs(a.dir.x * d.y - a.dir.y * d.x) > 0.5f * min_h) return false;
+    float t = a.dir.dot(d);
+    float shared = std::min(0.5f * a.length, t + 0.5f * b.length)
+                 - std::max(-0.5f * a.length, t - 0.5f * b.length);
+    return shared >= 0.75f * overlap;
+}
+
+void Detectioner::mergeBoxes(std::vector<BoxWithCoord>& boxes, int overlap) {
+    // larger boxes first, partial boxes cut at a tile border get folded into them
+    std::vector<float> areas(boxes.size());
+    std::vector<cv::Rect2f> rects(boxes.size());
+    std::vector<LineAxis> axes(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        areas[i] = static_cast<float>(cv::contourArea(boxes[i].box));
+        rects[i] = cv::boundingRect(boxes[i].box);
+        axes[i]  = lineAxis(boxes[i].box);
+    }
+
+    std::vector<int> order(boxes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return areas[a] > areas[b]; });
+
+    std::vector<bool> removed(boxes.size(), false);
+    for (size_t m = 0; m < order.size(); ++m) {
+        int i = order[m];
+        if (removed[i]) continue;
+        for (size_t n = m + 1; n < order.size(); ++n) {
+            int j = order[n];
+            if (removed[j] || (rects[i] & rects[j]).area() <= 0.f) continue;
+
+            std::vector<cv::Point2f> inter;
+            float inter_area = cv::intersectConvexConvex(boxes[i].box, boxes[j].box, inter, true);
+            float min_area = std::max(1.f, std::min(areas[i], areas[j]));
+            if (inter_area / min_area < m_params->tileMergeThresh
+             && !sameLinePieces(axes[i], axes[j], overlap)) continue;
+
+            std::vector<cv::Point2f> pts = boxes[i].box;
+            pts.insert(pts.end(), boxes[j].box.begin(), boxes[j].box.end());
+            auto merged = getMiniBoxes(pts);
+
+            boxes[i].box  = merged.first;
+            boxes[i].top  = std::min({merged.first[0].y, merged.first[1].y, merged.first[2].y, merged.first[3].y});
+            boxes[i].left = std::min({merged.first[0].x, merged.first[1].x, merged.first[2].x, merged.first[3].x});
+            areas[i]      = static_cast<float>(cv::contourArea(boxes[i].box));
+            rects[i]      = cv::boundingRect(boxes[i].box);
+            axes[i]       = lineAxis(boxes[i].box);
+            removed[j]    = true;
+        }
+    }
+
+    size_t keep = 0;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        if (!removed[i]) boxes[keep++] = boxes[i];
+    }
+    boxes.resize(keep);
+}
+
+// orders the box corners as a horizontal text line: tl, tr, br, bl
+static RoiQuad lineQuad(const std::vector<cv::Point2f>& box) {
+    cv::Point2f src_pts[4];
+    orderPoints(box, src_pts);
+
+    float dx = src_pts[1].x - src_pts[0].x;
+    float dy = src_pts[1].y - src_pts[0].y;
+    float width = std::hypot(dx, dy);
+
+    dx = src_pts[3].x - src_pts[0].x;
+    dy = src_pts[3].y - src_pts[0].y;
+    float height = std::hypot(dx, dy);
+
+    //swap width/height and rotate
+    if (height > width) {
+        std::swap(width, height);
+        cv::Point2f tmp[4];
+        tmp[0] = src_pts[3]; tmp[1] = src_pts[0];
+        tmp[2] = src_pts[1]; tmp[3] = src_pts[2];
+        for (int i=0;i<4;i++) src_pts[i] = tmp[i];
+    }
+
+    if (width < 2.f) width = 2.f;
+    if (height < 2.f) height = 2.f;
+
+    cv::Point2f top_center = (src_pts[0] + src_pts[1]) * 0.5f;
+    cv::Point2f bottom_center = (src_pts[2] + src_pts[3]) * 0.5f;
+    if (top_center.y > bottom_center.y) {
+        std::swap(src_pts[0], src_pts[3]);
+        std::swap(src_pts[1], src_pts[2]);
+    }
+
+    float left_sum = src_pts[0].x + src_pts[3].x;
+    float right_sum = src_pts[1].x + src_pts[2].x;
+    if (left_sum > right_sum) {
+        std::swap(src_pts[0], src_pts[1]);
+        std::swap(src_pts[3], src_pts[2]);
+    }
+
+    RoiQuad quad;
+    for (int i = 0; i < 4; i++) quad.pts[i] = src_pts[i];
+    quad.width  = width;
+    quad.height = height;
+    return quad;
+}
+
+void Detectioner::cropBoxes(InferContext& ctx, std::vector<BoxWithCoord>& valid_boxes) {
     std::sort(valid_boxes.begin(), valid_boxes.end(),
               [](const BoxWithCoord& a, const BoxWithCoord& b) {
                   return a.top != b.top ? a.top < b.top : a.left < b.left;
               });
 
+    // the quads are sampled straight into the cls/rec tensors, full resolution
+    // crops are only warped when they are saved or asked for
+    bool materialize = !m_params->fusedCrop || m_params->saveImg || m_params->keepCrops;
+
     const cv::Mat& src_mat = ctx.srcMat;
-    int idx = 0;
-    for (auto& b : valid_boxes) {
+    size_t first = ctx.roiQuads.size();
+    ctx.roiQuads.resize(first + valid_boxes.size());
+    if (materialize) {
+        ctx.roiMats.resize(first + valid_boxes.size());
+    }
+    if (m_params->cropGate) {
+        ctx.roiGates.resize(first + valid_boxes.size(), common::CROP_KEPT);
+    }
+    m_pool->parallelFor(static_cast<int>(valid_boxes.size()), [&](int idx) {
+        const BoxWithCoord& b = valid_boxes[idx];
         if (m_params->saveImg) {
             cv::Rect bbox = cv::boundingRect(b.box) & cv::Rect(0, 0, src_mat.cols, src_mat.rows);
             cv::Mat roi = src_mat(bbox).clone();
@@ -360,71 +540,186 @@ bool Detectioner::postProcessCpu(InferContext& ctx) {
             cv::imwrite(path, roi);
         }
 
-        cv::Point2f src_pts[4];
-        orderPoints(b.box, src_pts);
+        RoiQuad quad = lineQuad(b.box);
+        ctx.roiQuads[first + idx] = quad;
+
+        cv::Mat final_mat;
+        if (materialize) {
+            final_mat = cropQuad(src_mat, quad.pts, quad.width, quad.height, m_params->cropInterp);
 
-        float dx = src_pts[1].x - src_pts[0].x;
-        float dy = src_pts[1].y - src_pts[0].y;
-        float width = std::hypot(dx, dy);
+            if (m_params->saveImg) {
+                std::string path = "output/corrected_mat_" + std::to_string(idx) + ".png";
+                cv::imwrite(path, final_mat);
+            }
 
-        dx = src_pts[3].x - src_pts[0].x;
-        dy = src_pts[3].y - src_pts[0].y;
-        float height = std::hypot(dx, dy);
+            ctx.roiMats[first + idx] = final_mat;
+        }
 
-        //swap width/height and rotate
-        if (height > width) {
-            std::swap(width, height);
-            cv::Point2f tmp[4];
-            tmp[0] = src_pts[3]; tmp[1] = src_pts[0];
-            tmp[2] = src_pts[1]; tmp[3] = src_pts[2];
-            for (int i=0;i<4;i++) src_pts[i] = tmp[i];
+        if (m_params->cropGate) {
+            ctx.roiGates[first + idx] = gateCrop(src_mat, quad, final_mat);
         }
+    });
 
-        if (width < 2.f) width = 2.f;
-        if (height < 2.f) height = 2.f;
+    for (auto& b : valid_boxes) {
+        ctx.boxes.push_back(b.box);
+    }
 
-        cv::Point2f top_center = (src_pts[0] + src_pts[1]) * 0.5f;
-        cv::Point2f bottom_center = (src_pts[2] + src_pts[3]) * 0.5f;
-        if (top_center.y > bottom_center.y) {
-            std::swap(src_pts[0], src_pts[3]);
-            std::swap(src_pts[1], src_pts[2]);
+    LOGV("Boxes count:%d", ctx.boxes.size());
+    LOGV("Child mat count:%d", ctx.roiMats.size());
+}
+
+// Cheapest checks first: geometry from the quad, then contrast and ink on a
+// 16 px high gray thumbnail of the crop
+int Detectioner::gateCrop(const cv::Mat& src, const RoiQuad& quad, const cv::Mat& crop) {
+    if (quad.height < m_params->gateMinHeight) return common::CROP_LOW_HEIGHT;
+    if (m_params->gateMaxAspect > 0.f && quad.width > quad.height * m_params->gateMaxAspect) {
+        return common::CROP_ELONGATED;
+    }
+
+    cv::Mat gray = crop.empty() ? grayThumb(src, quad.pts, quad.width, quad.height, 16)
+                                : grayThumb(crop, nullptr, quad.width, quad.height, 16);
+    float contrast, ink;
+    cropContrastInk(gray, contrast, ink);
+    if (contrast < m_params->gateMinContrast) return common::CROP_LOW_CONTRAST;
+    if (ink < m_params->gateMinInk) return common::CROP_LOW_INK;
+    return common::CROP_KEPT;
+}
+
+bool Detectioner::postProcessCpu(InferContext& ctx) {
+    m_timer->startCpu();
+    assert(!ctx.outputTensor.empty());
+
+    // output map is [N, 1, H, W], H/W follow the actual input shape
+    auto out_shape = ctx.outputTensor[0].GetTensorTypeAndShapeInfo().GetShape();
+    int out_h = static_cast<int>(out_shape[out_shape.size() - 2]);
+    int out_w = static_cast<int>(out_shape[out_shape.size() - 1]);
+
+    float* float_array = ctx.outputTensor[0].GetTensorMutableData<float>();
+    cv::Mat out_mat(out_h, out_w, CV_32FC1, float_array);
+
+    DetTransform trans;
+    trans.scale   = m_scale;
+    trans.padTop  = m_padTop;
+    trans.padLeft = m_padLeft;
+    trans.valid   = m_validRect;
+    ctx.postArea  = static_cast<double>((m_validRect & cv::Rect(0, 0, out_w, out_h)).area()) / (out_w * out_h);
+
+    std::vector<BoxWithCoord> valid_boxes;
+    extractBoxes(out_mat, trans, ctx.srcMat.size(), valid_boxes);
+    cropBoxes(ctx, valid_boxes);
+
+    m_timer->stopCpu();
+    ctx.postTime = m_timer->durationCpu<timer::Timer::ms>("Detectioner postprocess(CPU)");
+
+    if(m_params->saveImg){
+        cv::imwrite("output/dec_dst.png", drawBoxes(ctx.srcMat, ctx.boxes));
+    }
+    return !ctx.boxes.empty();
+}
+
+static std::vector<int> tileStarts(int length, int tile, int stride) {
+    std::vector<int> starts;
+    if (length <= tile) {
+        starts.push_back(0);
+        return starts;
+    }
+    for (int s = 0; ; s += stride) {
+        // last tile is aligned to the far edge
+        if (s + tile >= length) {
+            starts.push_back(length - tile);
+            break;
         }
+        starts.push_back(s);
+    }
+    return starts;
+}
 
-        float left_sum = src_pts[0].x + src_pts[3].x;
-        float right_sum = src_pts[1].x + src_pts[2].x;
-        if (left_sum > right_sum) {
-            std::swap(src_pts[0], src_pts[1]);
-            std::swap(src_pts[3], src_pts[2]);
+bool Detectioner::inferenceTiled(InferContext& ctx) {
+    if(ctx.srcMat.empty()){
+        ctx.srcMat = cv::imread(ctx.imagePath);
+        if (ctx.srcMat.data == nullptr) {
+            LOGE("ERROR: Image file not founded! Program terminated"); 
+            return false;
         }
+    }
 
-        cv::Point2f dst_pts[4] = {
-            {0.f, 0.f},
-            {width - 1.f, 0.f},
-            {width - 1.f, height - 1.f},
-            {0.f, height - 1.f}
-        };
+    const cv::Mat& src_mat = ctx.srcMat;
+    m_srcWidth  = src_mat.cols;
+    m_srcHeight = src_mat.rows;
+
+    // tiles at native scale, shrunk to the 32-aligned page size for small pages
+    int tile    = (std::max(m_params->tileSize, 32) + 31) / 32 * 32;
+    int tile_w  = std::min(tile, (src_mat.cols + 31) / 32 * 32);
+    int tile_h  = std::min(tile, (src_mat.rows + 31) / 32 * 32);
+    int overlap = std::max(0, std::min(m_params->tileOverlap, tile / 2));
+
+    std::vector<cv::Rect> tiles;
+    for (int y : tileStarts(src_mat.rows, tile_h, tile_h - overlap)) {
+        for (int x : tileStarts(src_mat.cols, tile_w, tile_w - overlap)) {
+            tiles.emplace_back(cv::Rect(x, y, tile_w, tile_h) & cv::Rect(0, 0, src_mat.cols, src_mat.rows));
+        }
+    }
 
-        cv::Mat perspect_mat = cv::getPerspectiveTransform(src_pts, dst_pts);
-        cv::Mat final_mat;
-        cv::warpPerspective(src_mat, final_mat, perspect_mat,
-                            cv::Size((int)width, (int)height),
-                            cv::INTER_CUBIC,
-                            cv::BORDER_REPLICATE);
+    int tile_batch = std::max(1, m_params->tileBatch);
+    size_t single_size = 3 * tile_h * tile_w;
+    double pre_time = 0.0, infer_time = 0.0, post_time = 0.0;
+    double valid_area = 0.0;
+    std::vector<BoxWithCoord> valid_boxes;
 
-        if (m_params->saveImg) {
-            std::string path = "output/corrected_mat_" + std::to_string(idx) + ".png";
-            cv::imwrite(path, final_mat);
+    // only tile_batch tiles are held as float tensor at a time
+    for (size_t first = 0; first < tiles.size(); first += tile_batch) {
+        int batch = static_cast<int>(std::min(tiles.size() - first, (size_t)tile_batch));
+
+        m_timer->startCpu();
+        float* input = inputBuffer(ctx, {batch, 3, tile_h, tile_w}, ctx.inputValues);
+        for (int k = 0; k < batch; ++k) {
+            const cv::Rect& r = tiles[first + k];
+            cv::Mat tile_mat = src_mat(r);
+            if (r.width != tile_w || r.height != tile_h) {
+                cv::copyMakeBorder(tile_mat, tile_mat, 0, tile_h - r.height, 0, tile_w - r.width,
+                                   cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
+            } else if (!tile_mat.isContinuous()) {
+                tile_mat = tile_mat.clone();
+            }
+            // BGR -> RGB + normalize + CHW
+            toCHWFloat(tile_mat, input + k * single_size, m_meanValues, m_normValues);
         }
-
-        ctx.roiMats.push_back(final_mat);
-        ctx.boxes.push_back(b.box);
-        idx++;
+        m_timer->stopCpu();
+        pre_time += m_timer->durationCpu<timer::Timer::ms>("Detectioner tile preprocess(CPU)");
+
+        enqueueBindings(ctx);
+        infer_time += ctx.inferTime;
+
+        m_timer->startCpu();
+        float* float_array = ctx.outputTensor[0].GetTensorMutableData<float>();
+        for (int k = 0; k < batch; ++k) {
+            const cv::Rect& r = tiles[first + k];
+            cv::Mat out_mat(tile_h, tile_w, CV_32FC1, float_array + k * tile_h * tile_w);
+
+            DetTransform trans;
+            trans.offset = cv::Point2f(static_cast<float>(r.x), static_cast<float>(r.y));
+            trans.valid  = cv::Rect(0, 0, r.width, r.height);
+            valid_area  += r.area();
+            extractBoxes(out_mat, trans, src_mat.size(), valid_boxes);
+        }
+        m_timer->stopCpu();
+        post_time += m_timer->durationCpu<timer::Timer::ms>("Detectioner tile postprocess(CPU)");
     }
 
-    LOGV("Boxes count:%d", ctx.boxes.size());
-    LOGV("Child mat count:%d", ctx.roiMats.size());
+    ctx.inputValues.clear();
+    ctx.inputValues.shrink_to_fit();
+
+    m_timer->startCpu();
+    mergeBoxes(valid_boxes, overlap);
+    cropBoxes(ctx, valid_boxes);
     m_timer->stopCpu();
-    ctx.postTime = m_timer->durationCpu<timer::Timer::ms>("Detectioner postprocess(CPU)");
+    post_time += m_timer->durationCpu<timer::Timer::ms>("Detectioner postprocess(CPU)");
+
+    LOGV("Tiles count:%d", tiles.size());
+    ctx.preTime   = pre_time;
+    ctx.inferTime = infer_time;
+    ctx.postTime  = post_time;
+    ctx.postArea  = valid_area / (static_cast<double>(tiles.size()) * tile_w * tile_h);
 
     if(m_params->saveImg){
         cv::imwrite("output/dec_dst.png", drawBoxes(ctx.srcMat, ctx.boxes));
@@ -432,6 +727,195 @@ bool Detectioner::postProcessCpu(InferContext& ctx) {
     return !ctx.boxes.empty();
 }
 
+void Detectioner::inference(InferContext& ctx, std::string imagePath) {
+    if (m_params->detResize != common::det_resize_mode::TILED) {
+        Model::inference(ctx, imagePath);
+        return;
+    }
+    ctx.imagePath = imagePath;
+    assert(fileExists(imagePath));
+    inferenceTiled(ctx);
+}
+
+// Shelf packing: tallest first, left to right with m_params->packGap between
+// images and around the canvas border. Images above packMaxSide, or all of them
+// when packing is off, get a canvas of their own and are resized as usual.
+void Detectioner::planCanvases(std::vector<InferContext>& ctxs, std::vector<DetCanvas>& canvases) {
+    int canvas_w = m_params->img.w;
+    int canvas_h = m_params->img.h;
+    int gap      = std::max(0, m_params->packGap);
+
+    std::vector<int> packed;
+    for (int i = 0; i < (int)ctxs.size(); ++i) {
+        if (ctxs[i].failed) continue;
+        const cv::Mat& src = ctxs[i].srcMat;
+        bool small = m_params->detPack
+                  && std::max(src.cols, src.rows) <= m_params->packMaxSide
+                  && src.cols + 2 * gap <= canvas_w && src.rows + 2 * gap <= canvas_h;
+        if (small) {
+            packed.push_back(i);
+        } else {
+            DetCanvas canvas;
+            canvas.images.push_back(i);
+            canvases.push_back(canvas);
+        }
+    }
+
+    std::stable_sort(packed.begin(), packed.end(),
+                     [&](int a, int b) { return ctxs[a].srcMat.rows > ctxs[b].srcMat.rows; });
+
+    int x = gap, y = gap, shelf_h = 0;
+    DetCanvas canvas;
+    for (int i : packed) {
+        const cv::Mat& src = ctxs[i].srcMat;
+        if (x + src.cols + gap > canvas_w) {
+            x = gap;
+            y += shelf_h + gap;
+            shelf_h = 0;
+        }
+        // spill to the next canvas
+        if (y + src.rows + gap > canvas_h) {
+            canvases.push_back(canvas);
+            canvas = DetCanvas();
+            x = gap;
+            y = gap;
+            shelf_h = 0;
+        }
+        canvas.images.push_back(i);
+        canvas.places.emplace_back(x, y, src.cols, src.rows);
+        x += src.cols + gap;
+        shelf_h = std::max(shelf_h, src.rows);
+    }
+    if (!canvas.images.empty()) {
+        canvases.push_back(canvas);
+    }
+}
+
+// builds every canvas, pads them to one shape and runs a single {N, 3, H, W}
+// Session::Run, each image is postprocessed inside its own region and transform
+void Detectioner::runCanvases(std::vector<InferContext>& ctxs, const DetCanvas* canvases, int count) {
+    m_timer->startCpu();
+    std::vector<cv::Mat> imgs(count);
+    std::vector<std::vector<DetTransform>> transforms(count);
+    int in_h = 0, in_w = 0, images = 0;
+    for (int k = 0; k < count; ++k) {
+        const DetCanvas& canvas = canvases[k];
+        if (canvas.places.empty()) {
+            // resize works per channel, BGR -> RGB is done by toCHWFloat below
+            const cv::Mat& src = ctxs[canvas.images[0]].srcMat;
+            ResizePadInfo pad_info;
+            if (m_params->detResize == common::det_resize_mode::RESIZE_LONG) {
+                pad_info = resizeLong(src, m_limitSideLen);
+            } else {
+                pad_info = resizeAndPad(src, m_params->img.h, m_params->img.w);
+            }
+            DetTransform trans;
+            trans.scale   = pad_info.scale;
+            trans.padTop  = pad_info.padTop;
+            trans.padLeft = pad_info.padLeft;
+            trans.valid   = pad_info.valid;
+            imgs[k] = pad_info.img;
+            transforms[k].push_back(trans);
+        } else {
+            imgs[k] = cv::Mat(m_params->img.h, m_params->img.w, CV_8UC3, cv::Scalar(255, 255, 255));
+            for (size_t j = 0; j < canvas.places.size(); ++j) {
+                const cv::Rect& place = canvas.places[j];
+                ctxs[canvas.images[j]].srcMat.copyTo(imgs[k](place));
+                DetTransform trans;
+                trans.padTop  = place.y;
+                trans.padLeft = place.x;
+                trans.valid   = place;
+                transforms[k].push_back(trans);
+            }
+        }
+        in_h = std::max(in_h, imgs[k].rows);
+        in_w = std::max(in_w, imgs[k].cols);
+        images += static_cast<int>(canvas.images.size());
+    }
+
+    InferContext batch_ctx;
+    size_t single_size = 3 * in_h * in_w;
+    float* input = inputBuffer(batch_ctx, {count, 3, in_h, in_w}, m_batchInput);
+    for (int k = 0; k < count; ++k) {
+        cv::Mat img = imgs[k];
+        // long side resized images differ in shape, grow them on bottom/right
+        if (img.rows != in_h || img.cols != in_w) {
+            cv::copyMakeBorder(img, img, 0, in_h - img.rows, 0, in_w - img.cols,
+                               cv::BORDER_CONSTANT, cv::Scalar(255, 255, 255));
+        } else if (!img.isContinuous()) {
+            img = img.clone();
+        }
+        toCHWFloat(img, input + k * single_size, m_meanValues, m_normValues);
+    }
+    m_timer->stopCpu();
+    double pre_time = m_timer->durationCpu<timer::Timer::ms>("Detectioner batch preprocess(CPU)");
+
+    enqueueBindings(batch_ctx);
+
+    auto out_shape = batch_ctx.outputTensor[0].GetTensorTypeAndShapeInfo().GetShape();
+    int out_h = static_cast<int>(out_shape[out_shape.size() - 2]);
+    int out_w = static_cast<int>(out_shape[out_shape.size() - 1]);
+    float* float_array = batch_ctx.outputTensor[0].GetTensorMutableData<float>();
+
+    for (int k = 0; k < count; ++k) {
+        cv::Mat out_mat(out_h, out_w, CV_32FC1, float_array + (size_t)k * out_h * out_w);
+        for (size_t j = 0; j < canvases[k].images.size(); ++j) {
+            InferContext& ctx = ctxs[canvases[k].images[j]];
+            const DetTransform& trans = transforms[k][j];
+            m_timer->startCpu();
+            ctx.postArea = static_cast<double>((trans.valid & cv::Rect(0, 0, out_w, out_h)).area()) / (out_w * out_h);
+
+            std::vector<BoxWithCoord> valid_boxes;
+            extractBoxes(out_mat, trans, ctx.srcMat.size(), valid_boxes);
+            cropBoxes(ctx, valid_boxes);
+            m_timer->stopCpu();
+
+            // shared stages are split evenly over the images of the batch
+            ctx.preTime   = pre_time / images;
+            ctx.inferTime = batch_ctx.inferTime / images;
+            ctx.postTime  = m_timer->durationCpu<timer::Timer::ms>("Detectioner batch postprocess(CPU)");
+
+            if(m_params->saveImg){
+                cv::imwrite("output/dec_dst.png", drawBoxes(ctx.srcMat, ctx.boxes));
+            }
+        }
+    }
+}
+
+void Detectioner::inferenceBatch(std::vector<InferContext>& ctxs, const std::vector<std::string>& imagePaths) {
+    // tiles of one page already fill a batch
+    if (m_params->detResize == common::det_resize_mode::TILED) {
+        Model::inferenceBatch(ctxs, imagePaths);
+        return;
+    }
+
+    ctxs.resize(imagePaths.size());
+    for (size_t i = 0; i < imagePaths.size(); ++i) {
+        InferContext& ctx = ctxs[i];
+        ctx.imagePath = imagePaths[i];
+        assert(fileExists(imagePaths[i]));
+        if (ctx.srcMat.empty()) {
+            ctx.srcMat = cv::imread(ctx.imagePath);
+            if (ctx.srcMat.data == nullptr) {
+                // only this page is dropped, the rest of the list still runs
+                LOGE("ERROR: Image file not founded! %s skipped", ctx.imagePath.c_str());
+                ctx.failed = true;
+            }
+        }
+    }
+
+    std::vector<DetCanvas> canvases;
+    planCanvases(ctxs, canvases);
+    LOGV("Canvases count:%d", canvases.size());
+
+    // only det_batch canvases are held as float tensor at a time
+    int det_batch = std::max(1, m_params->detBatch);
+    for (size_t first = 0; first < canvases.size(); first += det_batch) {
+        int count = static_cast<int>(std::min(canvases.size() - first, (size_t)det_batch));
+        runCanvases(ctxs, canvases.data() + first, count);
+    }
+}
+
 bool Detectioner::postProcessCuda(InferContext& ctx){
     return postProcessCpu(ctx);
 }
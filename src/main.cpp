@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <cstring>
+#include <fstream>
 
 #include "logger.hpp"
 #include "creator.hpp"
@@ -24,8 +25,38 @@ void print_help() {
     cout << "  --infer_backend [ORTCPU/ORTCUDA/TRT]  Inference infer backend type, default ORTCPU\n";
     cout << "  --save_image [0/1]                    Whether to save inference image, default 1\n";
     cout << "  --image [path]                        Path to the image for inference (required)\n";
+    cout << "  --image_list [path]                   Text file with one image path per line, detected in batches\n";
     cout << "  --intra_threads [num]                 ORT intra-op threads, default 1\n";
     cout << "  --inter_threads [num]                 ORT inter-op threads, default 1\n";
+    cout << "  --post_threads [num]                  Detection postprocess threads, default 1\n";
+    cout << "  --fast_unclip [0/1]                   Closed-form unclip of detection boxes, default 1\n";
+    cout << "  --ort_global_pool [0/1]               Run all sessions on shared process wide ORT thread pools, default 0\n";
+    cout << "  --ort_global_intra [n]                Global intra-op threads, 0 one per core, default 0\n";
+    cout << "  --ort_global_inter [n]                Global inter-op threads, default 0\n";
+    cout << "  --ort_global_spin [0/1]               Global pool workers spin before sleeping, default 1\n";
+    cout << "  --ort_global_affinity [str]           Global intra-op thread affinity, e.g. \"1;2;3\", default none\n";
+    cout << "  --io_binding [0/1]                    Run every model through persistent bound input/output buffers, default 0\n";
+    cout << "  --det_batch [num]                     Images per detection run with --image_list, default 8\n";
+    cout << "  --det_pack [0/1]                      Pack small images of --image_list into shared canvases, default 0\n";
+    cout << "  --fused_crop [0/1]                    Sample text lines straight into cls/rec tensors, default 1\n";
+    cout << "  --crop_interp [nearest/linear/cubic]  Interpolation of saved/kept text line crops, default linear\n";
+    cout << "  --rec_batch [num]                     Text lines per recognition run, 1 runs them one by one, default 8\n";
+    cout << "  --rec_max_width [px]                  Cut longer text lines into overlapping segments, 0 disables, default 0\n";
+    cout << "  --rec_charset [chars]                 Only recognize these chars (e.g. 0123456789.), default whole dict\n";
+    cout << "  --angle_batch [n]                     Crops per angle cls run, default 8\n";
+    cout << "  --angle_page_vote [0/1]               Route the page by an angle cls vote over a line sample, default 0\n";
+    cout << "  --angle_page_sample [n]               Lines classified for the page vote, default 8\n";
+    cout << "  --crop_gate [0/1]                     Drop det crops too thin, flat or empty to read, default 0\n";
+    cout << "  --gate_min_height [px]                Crop gate minimum line height, default 6\n";
+    cout << "  --gate_min_contrast [std]             Crop gate minimum gray stddev, default 8\n";
+    cout << "  --gate_min_ink [ratio]                Crop gate minimum ink share, default 0.02\n";
+    cout << "  --rec_escalate [score]                Re-read lines scoring below this at full fidelity, 0 disables, default 0\n";
+    cout << "  --rec_cheap_scale [scale]             Width scale of the first rec pass when escalating, default 0.75\n";
+    cout << "  --rec_speculate [0/1]                 Recognize lines upright while the angle cls runs, default 0\n";
+    cout << "  --det_resize [letterbox/long/tile]    Detection input resize mode, default letterbox\n";
+    cout << "  --det_region [contour/component]      Detection region extractor, default contour\n";
+    cout << "  --tile_size [num]                     Tile size of tile detection mode, default 960\n";
+    cout << "  --tile_overlap [num]                  Tile overlap of tile detection mode, default 128\n";
 }
 
 common::task_type parse_task(const string &task_str) {
@@ -53,8 +84,35 @@ int main(int argc, char const *argv[])
     string infer_backend_str    = "ORTCPU";
     bool save_image             = true;
     string image_path           = "";
+    string image_list_path      = "";
     int intra_threads           = 1;
     int inter_threads           = 1;
+    int post_threads            = 1;
+    bool fast_unclip            = true;
+    bool io_binding             = false;
+    bool ort_global_pool        = false;
+    model::GlobalThreadPools global_pools;
+    int det_batch               = 8;
+    bool det_pack               = false;
+    bool fused_crop             = true;
+    string crop_interp_str      = "linear";
+    int rec_batch               = 8;
+    int rec_max_width           = 0;
+    string rec_charset          = "";
+    float rec_escalate          = 0.f;
+    int angle_batch             = 8;
+    bool angle_page_vote        = false;
+    int angle_page_sample       = 8;
+    bool crop_gate              = false;
+    float gate_min_height       = 6.f;
+    float gate_min_contrast     = 8.f;
+    float gate_min_ink          = 0.02f;
+    float rec_cheap_scale       = 0.75f;
+    bool rec_speculate          = false;
+    string det_resize_str       = "letterbox";
+    string det_region_str       = "contour";
+    int tile_size               = 960;
+    int tile_overlap            = 128;
 
     for(int i = 1; i < argc; ++i) {
         if(strcmp(argv[i], "--help") == 0) {
@@ -97,12 +155,102 @@ int main(int argc, char const *argv[])
         else if(strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
             image_path = argv[++i];
         }
+        else if(strcmp(argv[i], "--image_list") == 0 && i + 1 < argc) {
+            image_list_path = argv[++i];
+        }
         else if(strcmp(argv[i], "--intra_threads") == 0 && i + 1 < argc) {
             intra_threads = stoi(argv[++i]);
         }
         else if(strcmp(argv[i], "--inter_threads") == 0 && i + 1 < argc) {
             inter_threads = stoi(argv[++i]);
         }
+        else if(strcmp(argv[i], "--post_threads") == 0 && i + 1 < argc) {
+            post_threads = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--fast_unclip") == 0 && i + 1 < argc) {
+            fast_unclip = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--ort_global_pool") == 0 && i + 1 < argc) {
+            ort_global_pool = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--ort_global_intra") == 0 && i + 1 < argc) {
+            global_pools.intraThreads = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--ort_global_inter") == 0 && i + 1 < argc) {
+            global_pools.interThreads = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--ort_global_spin") == 0 && i + 1 < argc) {
+            global_pools.spin = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--ort_global_affinity") == 0 && i + 1 < argc) {
+            global_pools.intraAffinity = argv[++i];
+        }
+        else if(strcmp(argv[i], "--io_binding") == 0 && i + 1 < argc) {
+            io_binding = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--det_batch") == 0 && i + 1 < argc) {
+            det_batch = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--det_pack") == 0 && i + 1 < argc) {
+            det_pack = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--fused_crop") == 0 && i + 1 < argc) {
+            fused_crop = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--crop_interp") == 0 && i + 1 < argc) {
+            crop_interp_str = argv[++i];
+        }
+        else if(strcmp(argv[i], "--rec_batch") == 0 && i + 1 < argc) {
+            rec_batch = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--rec_max_width") == 0 && i + 1 < argc) {
+            rec_max_width = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--rec_charset") == 0 && i + 1 < argc) {
+            rec_charset = argv[++i];
+        }
+        else if(strcmp(argv[i], "--angle_batch") == 0 && i + 1 < argc) {
+            angle_batch = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--angle_page_vote") == 0 && i + 1 < argc) {
+            angle_page_vote = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--angle_page_sample") == 0 && i + 1 < argc) {
+            angle_page_sample = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--crop_gate") == 0 && i + 1 < argc) {
+            crop_gate = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--gate_min_height") == 0 && i + 1 < argc) {
+            gate_min_height = stof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--gate_min_contrast") == 0 && i + 1 < argc) {
+            gate_min_contrast = stof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--gate_min_ink") == 0 && i + 1 < argc) {
+            gate_min_ink = stof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--rec_escalate") == 0 && i + 1 < argc) {
+            rec_escalate = stof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--rec_speculate") == 0 && i + 1 < argc) {
+            rec_speculate = (stoi(argv[++i]) != 0);
+        }
+        else if(strcmp(argv[i], "--rec_cheap_scale") == 0 && i + 1 < argc) {
+            rec_cheap_scale = stof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--det_resize") == 0 && i + 1 < argc) {
+            det_resize_str = argv[++i];
+        }
+        else if(strcmp(argv[i], "--det_region") == 0 && i + 1 < argc) {
+            det_region_str = argv[++i];
+        }
+        else if(strcmp(argv[i], "--tile_size") == 0 && i + 1 < argc) {
+            tile_size = stoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--tile_overlap") == 0 && i + 1 < argc) {
+            tile_overlap = stoi(argv[++i]);
+        }
         else {
             cerr << "Unknown option: " << argv[i] << "\n";
             print_help();
@@ -110,11 +258,31 @@ int main(int argc, char const *argv[])
         }
     }
 
-    if(image_path.empty()) {
+    if(image_path.empty() && image_list_path.empty()) {
         cerr << "Error: --image is null\n";
         print_help();
         return 1;
     }
+
+    if(angle_page_vote && angle_page_sample < 1) {
+        cerr << "Error: --angle_page_sample must be at least 1\n";
+        print_help();
+        return 1;
+    }
+
+    vector<string> image_list;
+    if(!image_list_path.empty()) {
+        ifstream ifs(image_list_path);
+        if(!ifs.is_open()) {
+            cerr << "Error: failed to open " << image_list_path << "\n";
+            return 1;
+        }
+        string line;
+        while(getline(ifs, line)) {
+            if(!line.empty() && line.back() == '\r') line.pop_back();
+            if(!line.empty()) image_list.push_back(line);
+        }
+    }
     
     if (!ensure_dir("output")) {
         return -1;
@@ -126,32 +294,72 @@ int main(int argc, char const *argv[])
     if(infer_backend_str == "ORTCUDA") infer_backend = common::infer_backend::ORT_CUDA;
     else if(infer_backend_str == "TRT") infer_backend = common::infer_backend::TRT;
 
+    common::det_resize_mode det_resize = common::det_resize_mode::LETTERBOX;
+    if(det_resize_str == "long") det_resize = common::det_resize_mode::RESIZE_LONG;
+    else if(det_resize_str == "tile") det_resize = common::det_resize_mode::TILED;
+
+    int crop_interp = cv::INTER_LINEAR;
+    if(crop_interp_str == "nearest") crop_interp = cv::INTER_NEAREST;
+    else if(crop_interp_str == "cubic") crop_interp = cv::INTER_CUBIC;
+
+    common::det_region_mode det_region = common::det_region_mode::CONTOURS;
+    if(det_region_str == "component") det_region = common::det_region_mode::COMPONENTS;
+
     auto det_params = model::ModelParams();
     det_params.task         = common::task_type::DETECTION;
     det_params.inferBackend = infer_backend;
     det_params.saveImg      = save_image;
+    det_params.ioBinding    = io_binding;
+    det_params.sharedThreadPool = ort_global_pool;
     det_params.onnxPath     = det_model_path;
     det_params.inferYaml    = det_yaml_path;
     det_params.intraThreadnum = intra_threads;
     det_params.interThreadnum = inter_threads;
+    det_params.postThreadnum  = post_threads;
+    det_params.fastUnclip     = fast_unclip;
+    det_params.detBatch       = det_batch;
+    det_params.detPack        = det_pack;
+    det_params.fusedCrop      = fused_crop;
+    det_params.cropInterp     = crop_interp;
+    det_params.cropGate       = crop_gate;
+    det_params.gateMinHeight  = gate_min_height;
+    det_params.gateMinContrast = gate_min_contrast;
+    det_params.gateMinInk     = gate_min_ink;
+    det_params.detResize      = det_resize;
+    det_params.detRegion      = det_region;
+    det_params.tileSize       = tile_size;
+    det_params.tileOverlap    = tile_overlap;
 
     auto angle_params = model::ModelParams();
     angle_params.task           = common::task_type::ANGLECLS;
     angle_params.inferBackend   = infer_backend;
     angle_params.saveImg        = save_image;
+    angle_params.ioBinding      = io_binding;
+    angle_params.sharedThreadPool = ort_global_pool;
     angle_params.onnxPath       = angle_model_path;
     angle_params.inferYaml      = angle_yaml_path;
     angle_params.intraThreadnum = intra_threads;
     angle_params.interThreadnum = inter_threads;
+    angle_params.angleBatchSize = angle_batch;
+    angle_params.anglePageVote  = angle_page_vote;
+    angle_params.anglePageSample = angle_page_sample;
 
     auto rec_params = model::ModelParams();
     rec_params.task         = common::task_type::RECOGNIZE;
     rec_params.inferBackend = infer_backend;
     rec_params.saveImg      = save_image;
+    rec_params.ioBinding    = io_binding;
+    rec_params.sharedThreadPool = ort_global_pool;
     rec_params.onnxPath     = rec_model_path;
     rec_params.inferYaml    = rec_yaml_path;
     rec_params.intraThreadnum = intra_threads;
     rec_params.interThreadnum = inter_threads;
+    rec_params.recBatchSize   = rec_batch;
+    rec_params.recMaxWidth    = rec_max_width;
+    rec_params.recCharset     = rec_charset;
+    rec_params.recEscalateThresh = rec_escalate;
+    rec_params.recCheapScale  = rec_cheap_scale;
+    rec_params.recSpeculate   = rec_speculate;
 
     std::vector<model::ModelParams> param_list;
     auto task = parse_task(task_str);
@@ -167,14 +375,54 @@ int main(int argc, char const *argv[])
         param_list.emplace_back(rec_params);
     }
 
+    if (ort_global_pool) {
+        model::OrtEnvSingleton::useGlobalThreadPools(global_pools);
+    }
     auto creator = ocrcreator::createCreator(param_list, level);
 
+    if(!image_list.empty()) {
+        auto rets_list = creator->inference(image_list);
+        for (size_t i = 0; i < rets_list.size(); ++i) {
+            if (rets_list[i]->failed) {
+                LOGE("Image[%zu] %s: unreadable, skipped", i, image_list[i].c_str());
+                continue;
+            }
+            LOG("Image[%zu] %s: %zu boxes", i, image_list[i].c_str(), rets_list[i]->decBoxes.size());
+            for (size_t j = 0; j < rets_list[i]->regRets.size(); ++j) {
+                LOG("Batch[%zu] OCR Result: %s (%.3f)", j, rets_list[i]->regRets[j].c_str(), rets_list[i]->regScores[j]);
+            }
+            if (angle_page_vote) {
+                LOG("Image[%zu] page angle: %d, per-line angle cls: %d", i,
+                    rets_list[i]->pageAngle, rets_list[i]->angleFallback);
+            }
+            if (crop_gate) {
+                LOG("Image[%zu] crop gate rejected: %d of %zu boxes", i,
+                    rets_list[i]->gateRejected, rets_list[i]->decBoxes.size());
+            }
+            if (rec_escalate > 0.f) {
+                LOG("Image[%zu] rec lines: %d, escalated: %d, improved: %d", i,
+                    rets_list[i]->recLines, rets_list[i]->recEscalated, rets_list[i]->recImproved);
+            }
+        }
+        return 0;
+    }
+
     auto rets = creator->inference(image_path);
     for (size_t j = 0; j < rets->regRets.size(); ++j) {
-        LOG("Batch[%zu] OCR Result: %s", j, rets->regRets[j].c_str());
+        LOG("Batch[%zu] OCR Result: %s (%.3f)", j, rets->regRets[j].c_str(), rets->regScores[j]);
+    }
+    if (angle_page_vote) {
+        LOG("Page angle: %d, per-line angle cls: %d", rets->pageAngle, rets->angleFallback);
+    }
+    if (crop_gate) {
+        LOG("Crop gate rejected: %d of %zu boxes", rets->gateRejected, rets->decBoxes.size());
+    }
+    if (rec_escalate > 0.f) {
+        LOG("Rec lines: %d, escalated: %d, improved: %d", rets->recLines, rets->recEscalated, rets->recImproved);
     }
     LOG("Total preprocess time: %0.6lf ms", rets->preTime);
     LOG("Total inference time: %0.6lf ms", rets->inferTime);
     LOG("Total postprocess time: %0.6lf ms", rets->postTime);
+    LOG("Total wall time: %0.6lf ms", rets->wallTime);
     return 0;
 }
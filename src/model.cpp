@@ -1,5 +1,7 @@
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <algorithm>
 #include "utils.hpp" 
 #include "model.hpp"
 #include "logger.hpp"
@@ -7,6 +9,40 @@
 using namespace std;
 namespace model{
 
+static std::atomic<uint64_t> s_tensorAllocs(0);
+
+uint64_t tensorAllocations() {
+    return s_tensorAllocs.load();
+}
+
+bool OrtEnvSingleton::useGlobalThreadPools(const GlobalThreadPools& pools) {
+    if (created()) return false;
+    OrtEnvSingleton::pools().reset(new GlobalThreadPools(pools));
+    return true;
+}
+
+Ort::Env OrtEnvSingleton::createEnv() {
+    created() = true;
+    if (!pools()) {
+        return Ort::Env(ORT_LOGGING_LEVEL_ERROR, "PaddleOCR-ONNX");
+    }
+    const GlobalThreadPools& p = *pools();
+    Ort::ThreadingOptions options;
+    options.SetGlobalIntraOpNumThreads(p.intraThreads);
+    options.SetGlobalInterOpNumThreads(p.interThreads);
+    options.SetGlobalSpinControl(p.spin ? 1 : 0);
+    if (!p.intraAffinity.empty()) {
+        options.SetGlobalIntraOpThreadAffinity(p.intraAffinity.c_str());
+    }
+    return Ort::Env(options, ORT_LOGGING_LEVEL_ERROR, "PaddleOCR-ONNX");
+}
+
+static size_t elementCount(const std::vector<int64_t>& shape) {
+    size_t count = 1;
+    for (int64_t d : shape) count *= static_cast<size_t>(d);
+    return count;
+}
+
 Model::Model(ModelParams &params, logger::Level level):m_inputName(nullptr, &free), m_outputName(nullptr, &free){
     m_logger        = make_shared<logger::Logger>(level);
     m_timer         = make_shared<timer::Timer>();
@@ -21,12 +57,25 @@ void Model::loadData(){}
 void Model::initModel() {
     if ( (m_params->inferBackend == common::infer_backend::ORT_CPU || m_params->inferBackend == common::infer_backend::ORT_CUDA)
      && m_onnxSession == nullptr) {
-        // init onnx runtime
-        m_onnxOptions.SetInterOpNumThreads(m_params->interThreadnum);
-        m_onnxOptions.SetIntraOpNumThreads(m_params->intraThreadnum);
+        // init onnx runtime, on the env's global pools or on private ones
+        if (m_params->sharedThreadPool && OrtEnvSingleton::globalThreadPools()) {
+            m_onnxOptions.DisablePerSessionThreads();
+        } else {
+            if (m_params->sharedThreadPool) {
+                LOGW("No global ORT thread pools, %s runs on its own", getFileName(m_params->onnxPath).c_str());
+            }
+            m_onnxOptions.SetInterOpNumThreads(m_params->interThreadnum);
+            m_onnxOptions.SetIntraOpNumThreads(m_params->intraThreadnum);
+        }
         m_onnxOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
 
-        m_onnxSession = std::make_shared<Ort::Session>(m_onnxEnv, m_params->onnxPath.c_str(), m_onnxOptions);
+        if (!m_modelData.empty()) {
+            m_onnxSession = std::make_shared<Ort::Session>(m_onnxEnv, m_modelData.data(), m_modelData.size(), m_onnxOptions);
+            m_modelData.clear();
+            m_modelData.shrink_to_fit();
+        } else {
+            m_onnxSession = std::make_shared<Ort::Session>(m_onnxEnv, m_params->onnxPath.c_str(), m_onnxOptions);
+        }
 
 #if INFTER_BACKEND_ID == INFER_ORT_CUDA
         if(m_params->inferBackend == common::infer_backend::ORT_CUDA)
@@ -88,19 +137,146 @@ void Model::inference(InferContext& ctx, std::string imagePath) {
     }
 }
 
+// models without a batched path run the images one by one
+void Model::inferenceBatch(std::vector<InferContext>& ctxs, const std::vector<std::string>& imagePaths) {
+    ctxs.resize(imagePaths.size());
+    for (size_t i = 0; i < imagePaths.size(); ++i) {
+        inference(ctxs[i], imagePaths[i]);
+        ctxs[i].failed = ctxs[i].srcMat.empty();
+    }
+}
+
 bool Model::enqueueBindings(InferContext& ctx) {
     m_timer->startCpu();
     const char* inputNames[]  = { m_inputName.get() };
     const char* outputNames[] = { m_outputName.get() };
     
-    if(ctx.inputTensor == nullptr){
-        LOGD("inputTensor is nullptr!!");
-        return false;
+    if (ctx.binding) {
+        runBound(ctx);
+    } else {
+        if(ctx.inputTensor == nullptr){
+            LOGD("inputTensor is nullptr!!");
+            return false;
+        }
+        ctx.outputTensor = m_onnxSession->Run(Ort::RunOptions{nullptr}, inputNames, &ctx.inputTensor, 1, outputNames, 1);
+        s_tensorAllocs++;
     }
-    ctx.outputTensor = m_onnxSession->Run(Ort::RunOptions{nullptr}, inputNames, &ctx.inputTensor, 1, outputNames, 1);
     m_timer->stopCpu();
     ctx.inferTime = m_timer->durationCpu<timer::Timer::ms>("enqueue_bindings(CPU)");
     return true;
 }
 
+// Input memory of the next run with the given shape, preprocessing writes the
+// tensor straight into it. Without ioBinding that is storage, grown as needed and
+// wrapped in ctx.inputTensor. With it, the persistent buffer of (shape, slot); a
+// second slot lets a caller fill the next input while the current one runs.
+float* Model::inputBuffer(InferContext& ctx, const std::vector<int64_t>& shape, std::vector<float>& storage, int slot) {
+    float* data = reserveInput(shape, storage, slot);
+    ctx.inputShape = shape;
+    if (m_params->ioBinding) {
+        ctx.binding = reserveBinding(shape, slot);
+        ctx.inputTensor = Ort::Value(nullptr);
+    } else {
+        ctx.binding = nullptr;
+        auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+        ctx.inputTensor = Ort::Value::CreateTensor<float>(mem_info, data, elementCount(shape),
+                                                          ctx.inputShape.data(), ctx.inputShape.size());
+    }
+    return data;
+}
+
+float* Model::reserveInput(const std::vector<int64_t>& shape, std::vector<float>& storage, int slot) {
+    if (m_params->ioBinding) {
+        return reserveBinding(shape, slot)->input.data();
+    }
+    size_t count = elementCount(shape);
+    if (storage.capacity() < count) s_tensorAllocs++;
+    storage.resize(count);
+    return storage.data();
+}
+
+ShapeBinding* Model::reserveBinding(const std::vector<int64_t>& shape, int slot) {
+    auto key = std::make_pair(shape, slot);
+    if (static_cast<int>(m_slotNow.size()) <= slot) m_slotNow.resize(slot + 1, nullptr);
+    // the binding another slot holds may be filled and waiting for its run
+    auto pinned = [&](const ShapeBinding* b) {
+        for (int s = 0; s < static_cast<int>(m_slotNow.size()); ++s) {
+            if (s != slot && m_slotNow[s] == b) return true;
+        }
+        return false;
+    };
+    auto it = m_shapeBindings.find(key);
+    if (it == m_shapeBindings.end()) {
+        if (static_cast<int>(m_shapeBindings.size()) >= std::max(2, m_params->ioBindingShapes)) {
+            auto lru = m_shapeBindings.end();
+            for (auto c = m_shapeBindings.begin(); c != m_shapeBindings.end(); ++c) {
+                if (pinned(&c->second)) continue;
+                if (lru == m_shapeBindings.end() || c->second.lastUse < lru->second.lastUse) lru = c;
+            }
+            // every binding pending, the cap is exceeded until one is released
+            if (lru != m_shapeBindings.end()) {
+                if (&lru->second == m_boundNow) {
+                    m_ioBinding->ClearBoundInputs();
+                    m_ioBinding->ClearBoundOutputs();
+                    m_boundNow = nullptr;
+                }
+                if (m_slotNow[slot] == &lru->second) m_slotNow[slot] = nullptr;
+                m_shapeBindings.erase(lru);
+            }
+        }
+
+        it = m_shapeBindings.emplace(key, ShapeBinding()).first;
+        ShapeBinding& b = it->second;
+        b.inShape = shape;
+        b.input.resize(elementCount(shape));
+        s_tensorAllocs++;
+        auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+        b.inTensor = Ort::Value::CreateTensor<float>(mem_info, b.input.data(), b.input.size(),
+                                                     b.inShape.data(), b.inShape.size());
+    }
+    it->second.lastUse = ++m_useClock;
+    m_slotNow[slot] = &it->second;
+    return &it->second;
+}
+
+// Runs the bound buffers of ctx.binding, rebinding only when the shape changed.
+// The first run of a shape lets ORT allocate the output, its shape sizes the
+// buffer every later run writes into.
+void Model::runBound(InferContext& ctx) {
+    ShapeBinding& b = *ctx.binding;
+    auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+    if (!m_ioBinding) {
+        m_ioBinding.reset(new Ort::IoBinding(*m_onnxSession));
+    }
+    if (m_boundNow != &b) {
+        m_ioBinding->ClearBoundInputs();
+        m_ioBinding->ClearBoundOutputs();
+        m_ioBinding->BindInput(m_inputName.get(), b.inTensor);
+        if (b.outTensor != nullptr) m_ioBinding->BindOutput(m_outputName.get(), b.outTensor);
+        else m_ioBinding->BindOutput(m_outputName.get(), mem_info);
+        m_boundNow = &b;
+    }
+
+    m_onnxSession->Run(Ort::RunOptions{nullptr}, *m_ioBinding);
+
+    if (b.outTensor == nullptr) {
+        std::vector<Ort::Value> outputs = m_ioBinding->GetOutputValues();
+        s_tensorAllocs++;
+        auto info = outputs[0].GetTensorTypeAndShapeInfo();
+        b.outShape = info.GetShape();
+        const float* data = outputs[0].GetTensorData<float>();
+        b.output.assign(data, data + info.GetElementCount());
+        s_tensorAllocs++;
+        b.outTensor = Ort::Value::CreateTensor<float>(mem_info, b.output.data(), b.output.size(),
+                                                      b.outShape.data(), b.outShape.size());
+        m_ioBinding->ClearBoundOutputs();
+        m_ioBinding->BindOutput(m_outputName.get(), b.outTensor);
+    }
+
+    // a view of the bound output, valid until the next run of this shape
+    ctx.outputTensor.clear();
+    ctx.outputTensor.emplace_back(Ort::Value::CreateTensor<float>(mem_info, b.output.data(), b.output.size(),
+                                                                  b.outShape.data(), b.outShape.size()));
+}
+
 } // namespace model
@@ -0,0 +1,265 @@
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "onnxedit.hpp"
+
+namespace onnxedit{
+
+// wire types
+static const int WIRE_VARINT = 0;
+static const int WIRE_FIXED64 = 1;
+static const int WIRE_BYTES = 2;
+static const int WIRE_FIXED32 = 5;
+
+// field numbers used on the way down to the classifier
+static const uint32_t MODEL_GRAPH = 7;
+static const uint32_t GRAPH_INITIALIZER = 5;
+static const uint32_t GRAPH_OUTPUT = 12;
+static const uint32_t GRAPH_VALUE_INFO = 13;
+static const uint32_t TENSOR_DIMS = 1;
+static const uint32_t TENSOR_DATA_TYPE = 2;
+static const uint32_t TENSOR_RAW_DATA = 9;
+static const uint32_t VALUE_INFO_TYPE = 2;
+static const uint32_t TYPE_TENSOR = 1;
+static const uint32_t TENSOR_TYPE_SHAPE = 2;
+static const uint32_t SHAPE_DIM = 1;
+static const uint32_t DIM_VALUE = 1;
+static const uint64_t DATA_TYPE_FLOAT = 1;
+
+struct Field {
+    uint32_t                number;
+    int                     wire;
+    uint64_t                varint;     // WIRE_VARINT value
+    const unsigned char*    data;       // WIRE_BYTES payload
+    size_t                  size;
+    const unsigned char*    begin;      // whole field, key included
+    const unsigned char*    end;
+};
+
+static bool readVarint(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static void writeVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static bool nextField(const unsigned char*& p, const unsigned char* end, Field& f) {
+    f.begin = p;
+    uint64_t key;
+    if (!readVarint(p, end, key)) return false;
+    f.number = static_cast<uint32_t>(key >> 3);
+    f.wire   = static_cast<int>(key & 7);
+    f.data   = nullptr;
+    f.size   = 0;
+    switch (f.wire) {
+        case WIRE_VARINT:
+            if (!readVarint(p, end, f.varint)) return false;
+            break;
+        case WIRE_FIXED64:
+            if (end - p < 8) return false;
+            p += 8;
+            break;
+        case WIRE_FIXED32:
+            if (end - p < 4) return false;
+            p += 4;
+            break;
+        case WIRE_BYTES: {
+            uint64_t len;
+            if (!readVarint(p, end, len) || len > static_cast<uint64_t>(end - p)) return false;
+            f.data = p;
+            f.size = static_cast<size_t>(len);
+            p += len;
+            break;
+        }
+        default:
+            return false;
+    }
+    f.end = p;
+    return true;
+}
+
+static void writeBytes(std::string& out, uint32_t number, const std::string& payload) {
+    writeVarint(out, (static_cast<uint64_t>(number) << 3) | WIRE_BYTES);
+    writeVarint(out, payload.size());
+    out.append(payload);
+}
+
+// Copies a message field by field, edit may write a field itself and return true
+typedef std::function<bool(const Field&, std::string&)> FieldEdit;
+
+static bool rewrite(const unsigned char* data, size_t size, std::string& out, const FieldEdit& edit) {
+    const unsigned char* p = data;
+    const unsigned char* end = data + size;
+    Field f;
+    while (p < end) {
+        if (!nextField(p, end, f)) return false;
+        if (!edit(f, out)) {
+            out.append(reinterpret_cast<const char*>(f.begin), f.end - f.begin);
+        }
+    }
+    return true;
+}
+
+// Rewrites a nested message field through edit, false on a malformed payload
+static bool rewriteNested(const Field& f, std::string& out, const FieldEdit& edit) {
+    std::string payload;
+    if (!rewrite(f.data, f.size, payload, edit)) return false;
+    writeBytes(out, f.number, payload);
+    return true;
+}
+
+class Restrictor {
+public:
+    Restrictor(int classes, const std::vector<int>& keep) : m_classes(classes), m_keep(keep) {}
+
+    bool model(const std::vector<unsigned char>& src, std::string& out) {
+        m_ok = true;
+        bool parsed = rewrite(src.data(), src.size(), out, [&](const Field& f, std::string& o) {
+            if (f.number != MODEL_GRAPH || f.wire != WIRE_BYTES) return false;
+            return rewriteNested(f, o, [&](const Field& g, std::string& go) { return graphField(g, go); });
+        });
+        return parsed && m_ok && m_weights == 1 && m_biases <= 1;
+    }
+
+private:
+    bool graphField(const Field& f, std::string& out) {
+        if (f.wire != WIRE_BYTES) return false;
+        if (f.number == GRAPH_INITIALIZER) return tensor(f, out);
+        if (f.number == GRAPH_OUTPUT || f.number == GRAPH_VALUE_INFO) {
+            // ValueInfoProto.type -> TypeProto.tensor_type -> shape -> dim -> dim_value
+            bool parsed = rewriteNested(f, out, [&](const Field& v, std::string& vo) {
+                return nested(v, vo, VALUE_INFO_TYPE, [&](const Field& t, std::string& to) {
+                    return nested(t, to, TYPE_TENSOR, [&](const Field& tt, std::string& tto) {
+                        return nested(tt, tto, TENSOR_TYPE_SHAPE, [&](const Field& s, std::string& so) {
+                            return nested(s, so, SHAPE_DIM, [&](const Field& d, std::string& dout) {
+                                if (d.number != DIM_VALUE || d.wire != WIRE_VARINT) return false;
+                                if (d.varint != static_cast<uint64_t>(m_classes)) return false;
+                                writeVarint(dout, (static_cast<uint64_t>(DIM_VALUE) << 3) | WIRE_VARINT);
+                                writeVarint(dout, m_keep.size());
+                                return true;
+                            });
+                        });
+                    });
+                });
+            });
+            if (!parsed) m_ok = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Descends into the given message field, others are copied
+    bool nested(const Field& f, std::string& out, uint32_t number, const FieldEdit& edit) {
+        if (f.number != number || f.wire != WIRE_BYTES) return false;
+        if (!rewriteNested(f, out, edit)) m_ok = false;
+        return true;
+    }
+
+    bool tensor(const Field& f, std::string& out) {
+        std::vector<int64_t> dims;
+        uint64_t data_type = 0;
+        const unsigned char* raw = nullptr;
+        size_t raw_size = 0;
+
+        const unsigned char* p = f.data;
+        const unsigned char* end = f.data + f.size;
+        Field t;
+        while (p < end) {
+            if (!nextField(p, end, t)) return false;
+            if (t.number == TENSOR_DIMS && t.wire == WIRE_VARINT) {
+                dims.push_back(static_cast<int64_t>(t.varint));
+            } else if (t.number == TENSOR_DIMS && t.wire == WIRE_BYTES) {
+                const unsigned char* q = t.data;
+                uint64_t v;
+                while (q < t.data + t.size && readVarint(q, t.data + t.size, v)) {
+                    dims.push_back(static_cast<int64_t>(v));
+                }
+            } else if (t.number == TENSOR_DATA_TYPE && t.wire == WIRE_VARINT) {
+                data_type = t.varint;
+            } else if (t.number == TENSOR_RAW_DATA && t.wire == WIRE_BYTES) {
+                raw = t.data;
+                raw_size = t.size;
+            }
+        }
+
+        bool weight = dims.size() == 2 && dims[1] == m_classes;
+        bool bias   = dims.size() == 1 && dims[0] == m_classes;
+        if (!(weight || bias) || data_type != DATA_TYPE_FLOAT || raw == nullptr) return false;
+        int64_t rows = weight ? dims[0] : 1;
+        if (raw_size != static_cast<size_t>(rows * m_classes) * sizeof(float)) return false;
+
+        // kept columns of every row, values are little endian floats copied as is
+        std::string cut;
+        cut.resize(static_cast<size_t>(rows) * m_keep.size() * sizeof(float));
+        char* dst = &cut[0];
+        for (int64_t r = 0; r < rows; ++r) {
+            const unsigned char* row = raw + static_cast<size_t>(r * m_classes) * sizeof(float);
+            for (int c : m_keep) {
+                std::memcpy(dst, row + static_cast<size_t>(c) * sizeof(float), sizeof(float));
+                dst += sizeof(float);
+            }
+        }
+
+        bool dims_written = false;
+        std::string payload;
+        bool parsed = rewrite(f.data, f.size, payload, [&](const Field& t2, std::string& o) {
+            if (t2.number == TENSOR_DIMS) {
+                if (!dims_written) {
+                    for (size_t i = 0; i < dims.size(); ++i) {
+                        int64_t d = i + 1 == dims.size() ? static_cast<int64_t>(m_keep.size()) : dims[i];
+                        writeVarint(o, (static_cast<uint64_t>(TENSOR_DIMS) << 3) | WIRE_VARINT);
+                        writeVarint(o, static_cast<uint64_t>(d));
+                    }
+                    dims_written = true;
+                }
+                return true;
+            }
+            if (t2.number == TENSOR_RAW_DATA) {
+                writeBytes(o, TENSOR_RAW_DATA, cut);
+                return true;
+            }
+            return false;
+        });
+        if (!parsed) return false;
+
+        writeBytes(out, f.number, payload);
+        if (weight) m_weights++;
+        else m_biases++;
+        return true;
+    }
+
+private:
+    int                     m_classes;
+    const std::vector<int>& m_keep;
+    int                     m_weights = 0;
+    int                     m_biases  = 0;
+    bool                    m_ok      = true;
+};
+
+bool restrictClasses(const std::vector<unsigned char>& model, int classes,
+                     const std::vector<int>& keep, std::string& out) {
+    out.clear();
+    for (int c : keep) {
+        if (c < 0 || c >= classes) return false;
+    }
+    Restrictor restrictor(classes, keep);
+    if (!restrictor.model(model, out)) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+}; // namespace onnxedit
@@ -1,4 +1,6 @@
 #include <string>
+#include <cmath>
+#include <cfloat>
 #include <numeric>
 #include <fstream>
 
@@ -8,6 +10,8 @@
 #include "logger.hpp"
 #include "fkyaml.hpp"
 #include "recognizer.hpp"
+#include "onnxedit.hpp"
+#include "configcache.hpp"
 
 using namespace std;
 
@@ -15,34 +19,57 @@ namespace model{
 
 namespace recognizer {
 
-Recognizer::Recognizer(ModelParams &params, logger::Level level) : Model(params, level) {
-    std::ifstream ifs(params.inferYaml.c_str());
-    if (!ifs.is_open()) {
+Recognizer::Recognizer(ModelParams &params, logger::Level level) : Model(params, level), m_config(params.inferYaml) {
+    if (!m_config.opened()) {
         LOGE("Failed to open %s", params.inferYaml.c_str());
         assert(false);
         return;
     }
 
+    m_config.bind("channels", &m_channels);
+    m_config.bind("height", &m_dstHeight);
+    m_config.bind("width", &m_dstWidth);
+    m_config.bind(&m_charTable);
+    if (m_config.load()) {
+        LOG("Recognizer config loaded from cache %s.bin", params.inferYaml.c_str());
+    } else {
+        if (!parseYaml(m_config.yaml())) return;
+        if (!m_config.save()) {
+            LOGW("Failed to write config cache %s.bin", params.inferYaml.c_str());
+        }
+    }
+
+    if (!params.recCharset.empty()) {
+        restrictCharset(params.recCharset);
+    }
+
+    LOG("Recognizer input channels:%d", m_channels);
+    LOG("Recognizer input height:%d", m_dstHeight);
+    LOG("Recognizer input width:%d", m_dstWidth);
+    LOG("Recognizer keys count:%d", m_charTable.size());
+}
+
+bool Recognizer::parseYaml(const std::string& yaml) {
     fkyaml::node root;
     try {
-        root = fkyaml::node::deserialize(ifs);
+        root = fkyaml::node::deserialize(yaml.begin(), yaml.end());
     } catch (const std::exception &e) {
         LOGE("Failed to parse yaml: %s", e.what());
         assert(false);
-        return;
+        return false;
     }
 
     if (!root.contains("PreProcess")) {
         LOGE("PreProcess not found in yaml");
         assert(false);
-        return;
+        return false;
     }
 
     fkyaml::node preprocess = root["PreProcess"];
     if (!preprocess.contains("transform_ops") || !preprocess["transform_ops"].is_sequence()) {
         LOGE("transform_ops not found or is not a sequence");
         assert(false);
-        return;
+        return false;
     }
 
     fkyaml::node ops = preprocess["transform_ops"];
@@ -75,35 +102,77 @@ Recognizer::Recognizer(ModelParams &params, logger::Level level) : Model(params,
     if (!root.contains("PostProcess")) {
         LOGE("PostProcess not found in yaml");
         assert(false);
-        return;
+        return false;
     }
 
     fkyaml::node post_node = root["PostProcess"];
     if (!post_node.contains("character_dict") || !post_node["character_dict"].is_sequence()) {
         LOGE("character_dict missing or not a sequence");
         assert(false);
-        return;
+        return false;
     }
 
+    // blank, the dict, then the space char
     fkyaml::node charSeq = post_node["character_dict"];
-    m_characterList.reserve(charSeq.size() + 2);
+    m_charTable.push_back("blank", 5);
     for (auto &item : charSeq) {
         if (item.is_scalar()) {
-            m_characterList.emplace_back(item.get_value<std::string>());
+            std::string ch = item.get_value<std::string>();
+            m_charTable.push_back(ch.data(), ch.size());
         }
     }
-    m_characterList.emplace_back(std::string(" "));
-    m_characterList.insert(m_characterList.begin(), "blank");
+    m_charTable.push_back(" ", 1);
+    return true;
 
-    m_keys.reserve(m_characterList.size());
-    for (int i = 0; i < m_characterList.size(); i++) {
-        m_keys[i] = m_characterList[i];
+}
+
+// The session is built from a copy of the model whose classifier only keeps the
+// blank and the dict entries found in charset, m_charTable shrinks to the same
+// compact table so decoded indices map straight to chars.
+void Recognizer::restrictCharset(const std::string& charset) {
+    std::vector<int> keep = {0};
+    for (size_t i = 0; i < charset.size(); ) {
+        size_t n = 1;
+        unsigned char c = static_cast<unsigned char>(charset[i]);
+        if (c >= 0xf0) n = 4;
+        else if (c >= 0xe0) n = 3;
+        else if (c >= 0xc0) n = 2;
+        n = std::min(n, charset.size() - i);
+
+        int found = -1;
+        for (int k = 1; k < m_charTable.size(); ++k) {
+            if (m_charTable.equals(k, charset.data() + i, n)) {
+                found = k;
+                break;
+            }
+        }
+        if (found < 0) {
+            LOGW("Recognizer charset: '%s' not in character_dict, skipped", charset.substr(i, n).c_str());
+        } else {
+            keep.push_back(found);
+        }
+        i += n;
+    }
+    std::sort(keep.begin(), keep.end());
+    keep.erase(std::unique(keep.begin(), keep.end()), keep.end());
+    if (keep.size() == 1) {
+        LOGW("Recognizer charset has no dict char, full vocabulary kept");
+        return;
     }
 
-    LOG("Recognizer input channels:%d", m_channels);
-    LOG("Recognizer input height:%d", m_dstHeight);
-    LOG("Recognizer input width:%d", m_dstWidth);
-    LOG("Recognizer keys count:%d", m_keys.size());
+    std::vector<unsigned char> model = loadFile(m_params->onnxPath);
+    if (!onnxedit::restrictClasses(model, m_charTable.size(), keep, m_modelData)) {
+        LOGW("Recognizer charset: classifier of %d classes not found in %s, full vocabulary kept",
+             m_charTable.size(), m_params->onnxPath.c_str());
+        return;
+    }
+
+    configcache::CharTable compact;
+    for (int k : keep) {
+        compact.push_back(m_charTable.data(k), m_charTable.length(k));
+    }
+    LOG("Recognizer charset: %d of %d classes kept", compact.size(), m_charTable.size());
+    m_charTable = std::move(compact);
 }
 
 void Recognizer::setup(void const* data, size_t size) {
@@ -115,8 +184,10 @@ void Recognizer::setup(void const* data, size_t size) {
 }
 
 bool Recognizer::preProcessCpu(InferContext& ctx) {
+    bool fused = ctx.roiMats.empty() && !ctx.roiQuads.empty();
+
     // read to rgb
-    if(ctx.roiMats.empty()){
+    if(ctx.roiMats.empty() && !fused){
         ctx.srcMat =cv::imread(ctx.imagePath);
         if (ctx.srcMat.data == nullptr) {
             LOGE("ERROR: Image file not founded! Program terminated"); 
@@ -126,26 +197,46 @@ bool Recognizer::preProcessCpu(InferContext& ctx) {
         ctx.roiMats.emplace_back(ctx.srcMat);
     }
 
-
-    if(ctx.roiRoutes.size() != ctx.roiMats.size()){
+    size_t num_rois = fused ? ctx.roiQuads.size() : ctx.roiMats.size();
+    if(ctx.roiRoutes.size() != num_rois){
         LOGE("Error: angle vector info error");
         assert(false);
     }
 
     m_timer->startCpu();
-    int batch = static_cast<int>(ctx.roiMats.size());
+    int batch = static_cast<int>(num_rois);
     int index = 0;
     int max_width = 0;
-
-    ctx.inputValues.clear();
-    ctx.inputShape.clear();
+    float* input = nullptr;
+
+    if(fused){
+        // quads are sampled at the target height straight into the tensor
+        std::vector<int> rec_widths(batch);
+        for(int i = 0; i < batch; ++i){
+            const RoiQuad& quad = ctx.roiQuads[i];
+            float scale = (float) m_dstHeight / (float)(int) quad.height;
+            rec_widths[i] = std::max(1, static_cast<int>((int) quad.width * scale * ctx.recWidthScale));
+            max_width = std::max(max_width, rec_widths[i]);
+        }
+        max_width = std::max(max_width, m_padWidth);
+
+        size_t single_size = m_channels * m_dstHeight * max_width;
+        input = inputBuffer(ctx, {batch, m_channels, m_dstHeight, max_width}, ctx.inputValues);
+        for(int i = 0; i < batch; ++i){
+            const RoiQuad& quad = ctx.roiQuads[i];
+            float* dst_ptr = input + i * single_size;
+            warpQuadToCHW(ctx.srcMat, quad.pts, quad.width, quad.height,
+                          rec_widths[i], m_dstHeight, max_width, dst_ptr,
+                          m_meanValues, m_normValues, 1.f / 255.f, ctx.roiRoutes[i] != 0);
+        }
+    }
 
     std::vector<cv::Mat> resize_mats;
-    resize_mats.reserve(batch);
+    resize_mats.reserve(ctx.roiMats.size());
     for(auto &src_mat : ctx.roiMats){
         cv::Mat res_mat;
         float scale = (float) m_dstHeight / (float) src_mat.rows;
-        int rec_width = static_cast<int>(src_mat.cols*scale);
+        int rec_width = static_cast<int>(src_mat.cols*scale*ctx.recWidthScale);
         cv::resize(src_mat, res_mat, cv::Size(rec_width, m_dstHeight));
         resize_mats.emplace_back(res_mat);
         if(max_width < res_mat.cols){
@@ -153,8 +244,13 @@ bool Recognizer::preProcessCpu(InferContext& ctx) {
         }
     }
 
+    if(!fused){
+        max_width = std::max(max_width, m_padWidth);
+    }
     size_t single_size = m_channels * m_dstHeight * max_width;
-    ctx.inputValues.resize(batch*single_size);
+    if(!fused){
+        input = inputBuffer(ctx, {batch, m_channels, m_dstHeight, max_width}, ctx.inputValues);
+    }
     for(auto &src_mat : resize_mats){
         cv::Mat padd_mat = src_mat;
         int padd_right = max_width - src_mat.cols;
@@ -176,30 +272,220 @@ bool Recognizer::preProcessCpu(InferContext& ctx) {
             cv::rotate(padd_mat, dst_mat, cv::ROTATE_180);
         }
 
-        float* dst_ptr = ctx.inputValues.data() + index * single_size;
+        float* dst_ptr = input + index * single_size;
         toCHWFloat(dst_mat, dst_ptr, m_meanValues, m_normValues);
         index++;
     }
 
+    m_timer->stopCpu();
+    ctx.preTime = m_timer->durationCpu<timer::Timer::ms>("Recognizer preprocess(CPU)");
+    return true;
+}
 
-    ctx.inputShape = {batch, m_channels, m_dstHeight, max_width};
-    
-    switch(m_params->inferBackend){
-        case common::infer_backend::ORT_CUDA:
-        case common::infer_backend::ORT_CPU:{
-            auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
-            ctx.inputTensor = Ort::Value::CreateTensor<float>(mem_info, 
-                ctx.inputValues.data(), 
-                ctx.inputValues.size(), 
-                ctx.inputShape.data(), 
-                ctx.inputShape.size());
-            break;
+// line confidence is the mean probability of its chars, 0 for an empty line
+static float lineScore(const std::vector<float>& charScores) {
+    if (charScores.empty()) return 0.f;
+    return std::accumulate(charScores.begin(), charScores.end(), 0.f) / charScores.size();
+}
+
+// Lines are sorted by their width at the target height and grouped into the
+// first bucket width that holds them, up to recBatchSize per run. A run is only
+// padded to its bucket, lines wider than the last bucket run with their own width.
+// With recMaxWidth set, longer lines are first cut into overlapping segments that
+// run as lines of their own and are stitched back by the position of each char.
+void Recognizer::inference(InferContext& ctx, std::string imagePath) {
+    bool fused = ctx.roiMats.empty() && !ctx.roiQuads.empty();
+    int num = static_cast<int>(fused ? ctx.roiQuads.size() : ctx.roiMats.size());
+    ctx.imagePath = imagePath;
+    if (num == 0) {
+        // the whole image is a single line
+        assert(fileExists(imagePath));
+        ctx.srcMat = cv::imread(imagePath);
+        if (ctx.srcMat.data == nullptr) {
+            LOGE("ERROR: Image file not founded! Program terminated");
+            return;
         }
+        ctx.roiMats.emplace_back(ctx.srcMat);
+        ctx.roiRoutes.assign(1, 0);
+        num = 1;
+    }
+    if (static_cast<int>(ctx.roiRoutes.size()) != num) {
+        LOGE("Error: angle vector info error");
+        assert(false);
     }
 
-    m_timer->stopCpu();
-    ctx.preTime = m_timer->durationCpu<timer::Timer::ms>("Recognizer preprocess(CPU)");
-    return true;
+    auto recWidth = [&](float w, float h) {
+        return std::max(1, static_cast<int>(w * ((float) m_dstHeight / h) * ctx.recWidthScale));
+    };
+
+    // every segment spans [start, start + span) of its line in rec px, reading order
+    InferContext segs;
+    segs.srcMat = ctx.srcMat;
+    std::vector<int> seg_line, seg_start, seg_span;
+    std::vector<int> seg_count(num);
+    int max_seg = m_params->recMaxWidth;
+    int overlap = std::min(m_params->recOverlap, max_seg / 2);
+    for (int i = 0; i < num; ++i) {
+        float w = fused ? (float)(int) ctx.roiQuads[i].width  : (float) ctx.roiMats[i].cols;
+        float h = fused ? (float)(int) ctx.roiQuads[i].height : (float) ctx.roiMats[i].rows;
+        int line_width = recWidth(w, h);
+
+        std::vector<int> starts = {0};
+        if (max_seg > 0 && line_width > max_seg) {
+            starts.clear();
+            for (int a = 0; a + max_seg < line_width; a += max_seg - overlap) {
+                starts.push_back(a);
+            }
+            starts.push_back(line_width - max_seg);
+        }
+
+        seg_count[i] = static_cast<int>(starts.size());
+        for (int a : starts) {
+            int span = starts.size() > 1 ? max_seg : line_width;
+            seg_line.push_back(i);
+            seg_start.push_back(a);
+            seg_span.push_back(span);
+            segs.roiRoutes.push_back(ctx.roiRoutes[i]);
+            if (starts.size() == 1) {
+                if (fused) segs.roiQuads.push_back(ctx.roiQuads[i]);
+                else segs.roiMats.push_back(ctx.roiMats[i]);
+                continue;
+            }
+
+            // a rotated line is read from the far end of its crop
+            int c0 = ctx.roiRoutes[i] ? line_width - a - span : a;
+            float x0 = c0 * w / line_width;
+            float x1 = (c0 + span) * w / line_width;
+            if (fused) {
+                const RoiQuad& quad = ctx.roiQuads[i];
+                RoiQuad seg;
+                subQuad(quad.pts, quad.width, quad.height, x0, x1, seg.pts);
+                seg.width  = x1 - x0;
+                seg.height = quad.height;
+                segs.roiQuads.push_back(seg);
+            } else {
+                int col0 = std::max(0, std::min(ctx.roiMats[i].cols - 1, (int) std::round(x0)));
+                int col1 = std::max(col0 + 1, std::min(ctx.roiMats[i].cols, (int) std::round(x1)));
+                segs.roiMats.push_back(ctx.roiMats[i].colRange(col0, col1));
+            }
+        }
+    }
+
+    int total = static_cast<int>(seg_line.size());
+    std::vector<int> widths(total);
+    for (int i = 0; i < total; ++i) {
+        float w = fused ? (float)(int) segs.roiQuads[i].width  : (float) segs.roiMats[i].cols;
+        float h = fused ? (float)(int) segs.roiQuads[i].height : (float) segs.roiMats[i].rows;
+        widths[i] = recWidth(w, h);
+    }
+
+    std::vector<int> order(total);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return widths[a] < widths[b]; });
+
+    int max_batch = std::max(1, m_params->recBatchSize);
+    auto bucketOf = [&](int width) {
+        // a single line per run is never padded
+        if (max_batch == 1) return 0;
+        for (int b : m_params->recBuckets) {
+            if (width <= b) return b;
+        }
+        return width;
+    };
+
+    ctx.regResults.assign(num, std::string());
+    ctx.regCharScores.assign(num, std::vector<float>());
+    ctx.regScores.assign(num, 0.f);
+    ctx.preTime = ctx.inferTime = ctx.postTime = 0.0;
+
+    // char centers of split lines in rec px of the whole line
+    std::vector<std::vector<int>> seg_chars(total);
+    std::vector<std::vector<float>> seg_pos(total);
+    std::vector<std::vector<float>> seg_scores(total);
+
+    InferContext sub;
+    sub.imagePath = imagePath;
+    sub.srcMat    = ctx.srcMat;
+    sub.recWidthScale = ctx.recWidthScale;
+    for (int first = 0; first < total; ) {
+        int bucket = bucketOf(widths[order[first]]);
+        int last = first + 1;
+        while (last < total && last - first < max_batch && bucketOf(widths[order[last]]) == bucket) {
+            last++;
+        }
+
+        sub.roiQuads.clear();
+        sub.roiMats.clear();
+        sub.roiRoutes.clear();
+        for (int k = first; k < last; ++k) {
+            int i = order[k];
+            if (fused) sub.roiQuads.push_back(segs.roiQuads[i]);
+            else sub.roiMats.push_back(segs.roiMats[i]);
+            sub.roiRoutes.push_back(segs.roiRoutes[i]);
+        }
+
+        m_padWidth = bucket;
+        if (m_params->inferBackend == common::infer_backend::ORT_CUDA) preProcessCuda(sub);
+        else preProcessCpu(sub);
+        enqueueBindings(sub);
+        if (m_params->inferBackend == common::infer_backend::ORT_CUDA) postProcessCuda(sub);
+        else postProcessCpu(sub);
+        m_padWidth = 0;
+
+        // timestep t covers tensor columns [t, t + 1) * tensor width / steps
+        int steps = static_cast<int>(sub.outputTensor[0].GetTensorTypeAndShapeInfo().GetShape()[1]);
+        float step_px = (float) sub.inputShape[3] / steps;
+        for (int k = first; k < last && k - first < (int)sub.regResults.size(); ++k) {
+            int i = order[k];
+            int b = k - first;
+            if (seg_count[seg_line[i]] == 1) {
+                // back to the original line order
+                ctx.regResults[seg_line[i]]    = std::move(sub.regResults[b]);
+                ctx.regCharScores[seg_line[i]] = std::move(sub.regCharScores[b]);
+                ctx.regScores[seg_line[i]]     = sub.regScores[b];
+                continue;
+            }
+            // turned segments carry their padding on the left
+            float pad = sub.roiRoutes[b] ? (float)(sub.inputShape[3] - widths[i]) : 0.f;
+            float to_line = (float) seg_span[i] / widths[i];
+            seg_chars[i]  = std::move(sub.regChars[b]);
+            seg_scores[i] = std::move(sub.regCharScores[b]);
+            for (int t : sub.regSteps[b]) {
+                seg_pos[i].push_back(seg_start[i] + ((t + 0.5f) * step_px - pad) * to_line);
+            }
+        }
+        ctx.preTime   += sub.preTime;
+        ctx.inferTime += sub.inferTime;
+        ctx.postTime  += sub.postTime;
+        first = last;
+    }
+
+    // neighbouring segments hand over in the middle of their overlap
+    for (int i = 0; i < total; ) {
+        int line = seg_line[i];
+        int end = i + seg_count[line];
+        float last_pos = -FLT_MAX;
+        int last_char = -1;
+        int last_seg  = -1;
+        for (int s = i; end - i > 1 && s < end; ++s) {
+            float lo = s > i ? 0.5f * (seg_start[s] + seg_start[s - 1] + seg_span[s - 1]) : -FLT_MAX;
+            float hi = s + 1 < end ? 0.5f * (seg_start[s + 1] + seg_start[s] + seg_span[s]) : FLT_MAX;
+            for (size_t c = 0; c < seg_chars[s].size(); ++c) {
+                float pos = seg_pos[s][c];
+                if (pos < lo || pos >= hi) continue;
+                int idx = seg_chars[s][c];
+                // a char on the hand over is emitted by both segments a few px apart
+                if (idx == last_char && s != last_seg && pos - last_pos < 0.25f * m_dstHeight) continue;
+                m_charTable.append(ctx.regResults[line], idx);
+                ctx.regCharScores[line].push_back(seg_scores[s][c]);
+                last_pos  = pos;
+                last_char = idx;
+                last_seg  = s;
+            }
+        }
+        ctx.regScores[line] = lineScore(ctx.regCharScores[line]);
+        i = end;
+    }
 }
 
 bool Recognizer::preProcessCuda(InferContext& ctx){
@@ -219,54 +505,43 @@ bool Recognizer::postProcessCpu(InferContext& ctx) {
 
     LOG("Recognizer output shape: [%d, %d, %d]", batch, time_steps, num_classes);
 
-    ctx.regResults.clear();
-    ctx.regResults.reserve(batch);
-    
-    for (int b = 0; b < batch; ++b) {
-        std::string result;
-        int last_index = -1;
-        int same_count = 0;
-
-        float* batch_data = output_data + b * time_steps * num_classes;
-
-        for (int t = 0; t < time_steps; ++t) {
-            float* step_logits = batch_data + t * num_classes;
-
-            // argmax + second max
-            int max_index = 0;
-            float max_value = step_logits[0];
-            int second_index = -1;
-            float second_value = -1e9f;
-
-            for (int c = 1; c < num_classes; ++c) {
-                float v = step_logits[c];
-                if (v > max_value) {
-                    second_value = max_value;
-                    second_index = max_index;
-                    max_value = v;
-                    max_index = c;
-                } else if (v > second_value) {
-                    second_value = v;
-                    second_index = c;
-                }
-            }
-
-            // CTC collapse
-            if (max_index != 0 && max_index != last_index) {
-                if (max_index < (int)m_characterList.size()) {
-                    result += m_characterList[max_index];
-                }
-            }
-
-            if (max_index == last_index) {
-                same_count++;
-            }
+    // per-char buffers keep their capacity when the context is reused
+    ctx.regResults.resize(batch);
+    ctx.regChars.resize(batch);
+    ctx.regSteps.resize(batch);
+    ctx.regCharScores.resize(batch);
+    ctx.regScores.resize(batch);
 
-            last_index = max_index;
+    for (int b = 0; b < batch; ++b) {
+        const float* batch_data = output_data + (size_t) b * time_steps * num_classes;
+        std::vector<int>& chars = ctx.regChars[b];
+        std::vector<int>& steps = ctx.regSteps[b];
+        std::vector<float>& scores = ctx.regCharScores[b];
+        ctcGreedyDecode(batch_data, time_steps, num_classes, chars, steps, scores);
+
+        size_t kept = 0;
+        size_t bytes = 0;
+        for (size_t c = 0; c < chars.size(); ++c) {
+            if (chars[c] >= m_charTable.size()) continue;
+            chars[kept]  = chars[c];
+            steps[kept]  = steps[c];
+            scores[kept] = scores[c];
+            bytes += m_charTable.length(chars[c]);
+            kept++;
+        }
+        chars.resize(kept);
+        steps.resize(kept);
+        scores.resize(kept);
+
+        std::string& result = ctx.regResults[b];
+        result.clear();
+        result.reserve(bytes);
+        for (int c : chars) {
+            m_charTable.append(result, c);
         }
+        ctx.regScores[b] = lineScore(scores);
 
         LOG("Batch %d: OCR Result: %s", b, result.c_str());
-        ctx.regResults.emplace_back(std::move(result));
     }
 
     m_timer->stopCpu();
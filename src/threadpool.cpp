@@ -0,0 +1,87 @@
+#include <algorithm>
+
+#include "threadpool.hpp"
+
+namespace threadpool{
+
+ThreadPool::ThreadPool(int threads) {
+    int workers = std::max(1, threads) - 1;
+    m_workers.reserve(workers);
+    for (int i = 0; i < workers; ++i) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& t : m_workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::runJob(const std::function<void(int)>& fn, int count) {
+    for (int i = m_next.fetch_add(1); i < count; i = m_next.fetch_add(1)) {
+        fn(i);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    unsigned seen = 0;
+    for (;;) {
+        const std::function<void(int)>* fn;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stop || m_job != seen; });
+            if (m_stop) return;
+            seen = m_job;
+            // woken after parallelFor already returned, nothing left to join
+            if (m_fn == nullptr) continue;
+            // joined under the lock, parallelFor cannot return or start the next
+            // job until this worker checks out, so fn, count and m_next stay this job's
+            fn    = m_fn;
+            count = m_count;
+            m_active++;
+        }
+
+        runJob(*fn, count);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_active--;
+        }
+        m_done.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+    if (m_workers.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(m_submit);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn    = &fn;
+        m_count = count;
+        m_next  = 0;
+        m_job++;
+    }
+    m_wake.notify_all();
+
+    runJob(fn, count);
+
+    // all indices are taken, wait for the workers still running one
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_active == 0; });
+    m_fn    = nullptr;
+    m_count = 0;
+}
+
+}; // namespace threadpool
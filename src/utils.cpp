@@ -3,6 +3,15 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <climits>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UTILS_X86_DISPATCH
+#endif
 
 #include "utils.hpp"
 #include "model.hpp"
@@ -63,7 +72,38 @@ ResizePadInfo resizeAndPad(const cv::Mat& src, int targetH, int targetW, cv::Sca
         paddValue
     );
 
-    return {output, scale, top, left};
+    return {output, scale, top, left, cv::Rect(left, top, new_w, new_h)};
+}
+
+ResizePadInfo resizeLong(const cv::Mat& src, int limitSide, int align, cv::Scalar paddValue) {
+    int h = src.rows;
+    int w = src.cols;
+
+    // scale long side to limitSide, keep aspect ratio
+    float scale = static_cast<float>(limitSide) / std::max(h, w);
+
+    int new_h = std::max(1, static_cast<int>(std::round(h * scale)));
+    int new_w = std::max(1, static_cast<int>(std::round(w * scale)));
+
+    cv::Mat resized;
+    cv::resize(src, resized, cv::Size(new_w, new_h));
+
+    // round both sides up to multiples of align, pad on bottom/right only
+    int target_h = (new_h + align - 1) / align * align;
+    int target_w = (new_w + align - 1) / align * align;
+
+    cv::Mat output = resized;
+    if (target_h != new_h || target_w != new_w) {
+        cv::copyMakeBorder(
+            resized,
+            output,
+            0, target_h - new_h, 0, target_w - new_w,
+            cv::BORDER_CONSTANT,
+            paddValue
+        );
+    }
+
+    return {output, scale, 0, 0, cv::Rect(0, 0, new_w, new_h)};
 }
 
 cv::Mat drawBoxes(const cv::Mat& src, const std::vector<std::vector<cv::Point2f>>& boxes) {
@@ -91,6 +131,433 @@ cv::Mat drawBoxes(const cv::Mat& src, const std::vector<std::vector<cv::Point2f>
     return dst;
 }
 
+static void binarizeRow(const float* src, uchar* dst, int count, float thresh) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 t = _mm_set1_ps(thresh);
+    for (; i + 16 <= count; i += 16) {
+        // compare masks are all-ones/zero, signed packs keep -1 -> 0xff
+        __m128i m0 = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(src + i),      t));
+        __m128i m1 = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(src + i + 4),  t));
+        __m128i m2 = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(src + i + 8),  t));
+        __m128i m3 = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(src + i + 12), t));
+        __m128i w0 = _mm_packs_epi32(m0, m1);
+        __m128i w1 = _mm_packs_epi32(m2, m3);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi16(w0, w1));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = src[i] > thresh ? 255 : 0;
+    }
+}
+
+// same result as cv::threshold(THRESH_BINARY, 255) + convertTo(CV_8UC1) in one pass,
+// bitmap is only reallocated when the map size changes
+void binarizeMap(const cv::Mat& prob, cv::Mat& bitmap, float thresh) {
+    CV_Assert(prob.type() == CV_32FC1);
+    bitmap.create(prob.rows, prob.cols, CV_8UC1);
+
+    int rows = prob.rows;
+    int cols = prob.cols;
+    if (prob.isContinuous() && bitmap.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
+    for (int y = 0; y < rows; ++y) {
+        binarizeRow(prob.ptr<float>(y), bitmap.ptr<uchar>(y), cols, thresh);
+    }
+}
+
+static int argmaxScalar(const float* src, int count, float* maxVal) {
+    int   best = 0;
+    float v    = src[0];
+    for (int i = 1; i < count; ++i) {
+        if (src[i] > v) {
+            v = src[i];
+            best = i;
+        }
+    }
+    *maxVal = v;
+    return best;
+}
+
+#ifdef UTILS_X86_DISPATCH
+// lanes keep their first max, the smallest index among the lanes holding the
+// overall max is the first max of the row
+static int reduceLanes(const float* vals, const int* ids, int lanes, float* maxVal) {
+    int   best = ids[0];
+    float v    = vals[0];
+    for (int l = 1; l < lanes; ++l) {
+        if (vals[l] > v || (vals[l] == v && ids[l] < best)) {
+            v = vals[l];
+            best = ids[l];
+        }
+    }
+    *maxVal = v;
+    return best;
+}
+
+// four independent max chains hide the compare + blend latency
+__attribute__((target("avx2")))
+static int argmaxAvx2(const float* src, int count, float* maxVal) {
+    if (count < 32) return argmaxScalar(src, count, maxVal);
+
+    __m256  best_v[4];
+    __m256i best_i[4];
+    for (int k = 0; k < 4; ++k) {
+        best_v[k] = _mm256_loadu_ps(src + 8 * k);
+        best_i[k] = _mm256_setr_epi32(8 * k, 8 * k + 1, 8 * k + 2, 8 * k + 3,
+                                      8 * k + 4, 8 * k + 5, 8 * k + 6, 8 * k + 7);
+    }
+    __m256i idx = best_i[0];
+    const __m256i step = _mm256_set1_epi32(32);
+
+    int i = 32;
+    for (; i + 32 <= count; i += 32) {
+        idx = _mm256_add_epi32(idx, step);
+        for (int k = 0; k < 4; ++k) {
+            __m256  v  = _mm256_loadu_ps(src + i + 8 * k);
+            __m256  gt = _mm256_cmp_ps(v, best_v[k], _CMP_GT_OQ);
+            __m256i ik = _mm256_add_epi32(idx, _mm256_set1_epi32(8 * k));
+            best_v[k] = _mm256_blendv_ps(best_v[k], v, gt);
+            best_i[k] = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_i[k]),
+                                                             _mm256_castsi256_ps(ik), gt));
+        }
+    }
+
+    alignas(32) float vals[32];
+    alignas(32) int   ids[32];
+    for (int k = 0; k < 4; ++k) {
+        _mm256_store_ps(vals + 8 * k, best_v[k]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(ids + 8 * k), best_i[k]);
+    }
+    float v;
+    int best = reduceLanes(vals, ids, 32, &v);
+    for (; i < count; ++i) {
+        if (src[i] > v) {
+            v = src[i];
+            best = i;
+        }
+    }
+    *maxVal = v;
+    return best;
+}
+
+__attribute__((target("avx512f")))
+static int argmaxAvx512(const float* src, int count, float* maxVal) {
+    if (count < 64) return argmaxScalar(src, count, maxVal);
+
+    __m512  best_v[4];
+    __m512i best_i[4];
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (int k = 0; k < 4; ++k) {
+        best_v[k] = _mm512_loadu_ps(src + 16 * k);
+        best_i[k] = _mm512_add_epi32(lane, _mm512_set1_epi32(16 * k));
+    }
+
+    int i = 64;
+    for (; i + 64 <= count; i += 64) {
+        for (int k = 0; k < 4; ++k) {
+            __m512    v  = _mm512_loadu_ps(src + i + 16 * k);
+            __mmask16 gt = _mm512_cmp_ps_mask(v, best_v[k], _CMP_GT_OQ);
+            best_v[k] = _mm512_mask_blend_ps(gt, best_v[k], v);
+            best_i[k] = _mm512_mask_blend_epi32(gt, best_i[k], _mm512_add_epi32(lane, _mm512_set1_epi32(i + 16 * k)));
+        }
+    }
+
+    alignas(64) float vals[64];
+    alignas(64) int   ids[64];
+    for (int k = 0; k < 4; ++k) {
+        _mm512_store_ps(vals + 16 * k, best_v[k]);
+        _mm512_store_si512(ids + 16 * k, best_i[k]);
+    }
+    float v;
+    int best = reduceLanes(vals, ids, 64, &v);
+    for (; i < count; ++i) {
+        if (src[i] > v) {
+            v = src[i];
+            best = i;
+        }
+    }
+    *maxVal = v;
+    return best;
+}
+
+typedef int (*ArgmaxFn)(const float*, int, float*);
+
+static ArgmaxFn pickArgmax() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return argmaxAvx512;
+    if (__builtin_cpu_supports("avx2")) return argmaxAvx2;
+    return argmaxScalar;
+}
+#endif
+
+// Index of the first max of src[0, count), the widest instruction set of the
+// running CPU is picked once
+int argmaxRow(const float* src, int count, float* maxVal) {
+#ifdef UTILS_X86_DISPATCH
+    static const ArgmaxFn fn = pickArgmax();
+    return fn(src, count, maxVal);
+#else
+    return argmaxScalar(src, count, maxVal);
+#endif
+}
+
+// Greedy CTC over a (steps x classes) probability map: per step argmax, repeats
+// collapsed, blanks (class 0) dropped. Each kept char gets its step and its max
+// probability, the only pass over the map is the argmax itself.
+void ctcGreedyDecode(const float* probs, int steps, int classes,
+                     std::vector<int>& chars, std::vector<int>& charSteps, std::vector<float>& charScores) {
+    chars.clear();
+    charSteps.clear();
+    charScores.clear();
+    int last = -1;
+    for (int t = 0; t < steps; ++t) {
+        float score;
+        int index = argmaxRow(probs + (size_t) t * classes, classes, &score);
+        if (index != 0 && index != last) {
+            chars.push_back(index);
+            charSteps.push_back(t);
+            charScores.push_back(score);
+        }
+        last = index;
+    }
+}
+
+// Cohen-Sutherland clipping to [0, w-1] x [0, h-1], same rounding as cv::clipLine
+static bool clipSegment(int w, int h, cv::Point& p0, cv::Point& p1) {
+    int64_t right = w - 1, bottom = h - 1;
+    int64_t x1 = p0.x, y1 = p0.y, x2 = p1.x, y2 = p1.y;
+    int c1 = (x1 < 0) + (x1 > right) * 2 + (y1 < 0) * 4 + (y1 > bottom) * 8;
+    int c2 = (x2 < 0) + (x2 > right) * 2 + (y2 < 0) * 4 + (y2 > bottom) * 8;
+
+    if ((c1 & c2) == 0 && (c1 | c2) != 0) {
+        int64_t a;
+        if (c1 & 12) {
+            a = c1 < 8 ? 0 : bottom;
+            x1 += static_cast<int64_t>(static_cast<double>(a - y1) * (x2 - x1) / (y2 - y1));
+            y1 = a;
+            c1 = (x1 < 0) + (x1 > right) * 2;
+        }
+        if (c2 & 12) {
+            a = c2 < 8 ? 0 : bottom;
+            x2 += static_cast<int64_t>(static_cast<double>(a - y2) * (x2 - x1) / (y2 - y1));
+            y2 = a;
+            c2 = (x2 < 0) + (x2 > right) * 2;
+        }
+        if ((c1 & c2) == 0 && (c1 | c2) != 0) {
+            if (c1) {
+                a = c1 == 1 ? 0 : right;
+                y1 += static_cast<int64_t>(static_cast<double>(a - x1) * (y2 - y1) / (x2 - x1));
+                x1 = a;
+                c1 = 0;
+            }
+            if (c2) {
+                a = c2 == 1 ? 0 : right;
+                y2 += static_cast<int64_t>(static_cast<double>(a - x2) * (y2 - y1) / (x2 - x1));
+                x2 = a;
+                c2 = 0;
+            }
+        }
+    }
+
+    p0 = cv::Point(static_cast<int>(x1), static_cast<int>(y1));
+    p1 = cv::Point(static_cast<int>(x2), static_cast<int>(y2));
+    return (c1 | c2) == 0;
+}
+
+// per-row [lo, hi] coverage of an 8-connected line, same stepping as cv::LineIterator
+static void rasterLineSpans(cv::Point p0, cv::Point p1, int* lo, int* hi, int cols, int rows) {
+    if (!clipSegment(cols, rows, p0, p1)) return;
+    if (p0.x > p1.x) std::swap(p0, p1);
+    int dx = p1.x - p0.x;
+    int dy = p1.y - p0.y;
+    int sy = dy < 0 ? -1 : 1;
+    dy = std::abs(dy);
+
+    bool steep = dy > dx;
+    int major = steep ? dy : dx;
+    int minor = steep ? dx : dy;
+    int err = major - (minor + minor);
+
+    int x = p0.x, y = p0.y;
+    for (int i = 0; i <= major; ++i) {
+        lo[y] = std::min(lo[y], x);
+        hi[y] = std::max(hi[y], x);
+
+        bool step_minor = err < 0;
+        err += -(minor + minor) + (step_minor ? major + major : 0);
+        if (steep) {
+            y += sy;
+            if (step_minor) x++;
+        } else {
+            x++;
+            if (step_minor) y += sy;
+        }
+    }
+}
+
+// mean of prob inside the polygon with the exact coverage of cv::fillPoly (filled
+// spans + 8-connected outline) and masked cv::mean, summed along the row spans
+float polygonMeanScore(const cv::Mat& prob, const cv::Point2f* pts, int count) {
+    const int max_points = 16;
+    const int xy_shift = 16;
+    if (count <= 0 || count > max_points) return 0.0f;
+
+    int h = prob.rows;
+    int w = prob.cols;
+
+    float xmin_f = pts[0].x, xmax_f = pts[0].x;
+    float ymin_f = pts[0].y, ymax_f = pts[0].y;
+    for (int i = 1; i < count; ++i) {
+        xmin_f = std::min(xmin_f, pts[i].x);
+        xmax_f = std::max(xmax_f, pts[i].x);
+        ymin_f = std::min(ymin_f, pts[i].y);
+        ymax_f = std::max(ymax_f, pts[i].y);
+    }
+
+    int xmin = std::max(0, static_cast<int>(std::floor(xmin_f)));
+    int xmax = std::min(w - 1, static_cast<int>(std::ceil(xmax_f)));
+    int ymin = std::max(0, static_cast<int>(std::floor(ymin_f)));
+    int ymax = std::min(h - 1, static_cast<int>(std::ceil(ymax_f)));
+
+    if (xmax <= xmin || ymax <= ymin) return 0.0f;
+
+    int rows = ymax - ymin + 1;
+    int cols = xmax - xmin + 1;
+
+    // integer vertices relative to the clamped bbox, as the mask based version
+    cv::Point v[max_points];
+    for (int i = 0; i < count; ++i) {
+        v[i] = cv::Point(cvRound(pts[i].x - xmin), cvRound(pts[i].y - ymin));
+    }
+
+    // row span buffers are reused, no allocation once grown
+    thread_local std::vector<int> spans;
+    if (spans.size() < static_cast<size_t>(rows) * 4) {
+        spans.resize(rows * 4);
+    }
+    int* lo  = spans.data();
+    int* hi  = lo + rows;
+    int* flo = hi + rows;
+    int* fhi = flo + rows;
+    std::fill(lo, lo + rows, INT_MAX);
+    std::fill(hi, hi + rows, INT_MIN);
+    std::fill(flo, flo + rows, INT_MAX);
+    std::fill(fhi, fhi + rows, INT_MIN);
+
+    for (int i = 0, j = count - 1; i < count; j = i++) {
+        const cv::Point& a = v[j];
+        const cv::Point& b = v[i];
+
+        // outline
+        rasterLineSpans(a, b, lo, hi, cols, rows);
+        if (a.y == b.y) continue;
+
+        // edges crossing the border start from their clipped endpoints
+        int64_t ax = static_cast<int64_t>(a.x) << xy_shift, ay = a.y;
+        int64_t bx = static_cast<int64_t>(b.x) << xy_shift, by = b.y;
+        if ((unsigned)a.x >= (unsigned)cols || (unsigned)b.x >= (unsigned)cols ||
+            (unsigned)a.y >= (unsigned)rows || (unsigned)b.y >= (unsigned)rows) {
+            cv::Point t0 = a, t1 = b;
+            clipSegment(cols, rows, t0, t1);
+            if (t0.y != t1.y) {
+                ax = static_cast<int64_t>(t0.x) << xy_shift; ay = t0.y;
+                bx = static_cast<int64_t>(t1.x) << xy_shift; by = t1.y;
+            }
+        }
+
+        // filled span: fixed point edge x, rows [y0, y1)
+        int64_t dx = (bx - ax) / (by - ay);
+        int y0 = std::min(a.y, b.y);
+        int y1 = std::max(a.y, b.y);
+        int64_t x0 = a.y < b.y ? ax + (a.y - ay) * dx : bx + (b.y - by) * dx;
+        for (int y = std::max(y0, 0); y < std::min(y1, rows); ++y) {
+            int64_t x = x0 + (y - y0) * dx;
+            flo[y] = std::min(flo[y], static_cast<int>((x + (1 << xy_shift) - 1) >> xy_shift));
+            fhi[y] = std::max(fhi[y], static_cast<int>(x >> xy_shift));
+        }
+    }
+
+    double sum = 0.0;
+    int pixels = 0;
+    for (int y = 0; y < rows; ++y) {
+        if (flo[y] <= fhi[y]) {
+            lo[y] = std::min(lo[y], flo[y]);
+            hi[y] = std::max(hi[y], fhi[y]);
+        }
+        int xl = std::max(lo[y], 0);
+        int xr = std::min(hi[y], cols - 1);
+        if (xl > xr) continue;
+
+        const float* row = prob.ptr<float>(ymin + y) + xmin;
+        float row_sum = 0.f;
+        for (int x = xl; x <= xr; ++x) {
+            row_sum += row[x];
+        }
+        sum    += row_sum;
+        pixels += xr - xl + 1;
+    }
+
+    return pixels ? static_cast<float>(sum / pixels) : 0.0f;
+}
+
+// The min area rect of a region spanning dx x dy pixels has its short side at
+// most sqrt(2) * min(dx, dy): its long side is >= diameter / sqrt(2) and its
+// area is <= dx * dy. Regions under that bound can never yield a minSide box.
+bool belowMinSide(int dx, int dy, float minSide) {
+    float s = static_cast<float>(std::min(dx, dy));
+    return 2.f * s * s < minSide * minSide;
+}
+
+void selectContours(const std::vector<std::vector<cv::Point>>& contours, int maxCount, float minSide,
+                    std::vector<std::vector<cv::Point2f>>& selected) {
+    // drop specks first, areas are computed once for the survivors only
+    std::vector<int> order;
+    std::vector<double> areas(contours.size(), 0.0);
+    order.reserve(contours.size());
+    for (int i = 0; i < (int)contours.size(); ++i) {
+        cv::Rect r = cv::boundingRect(contours[i]);
+        if (belowMinSide(r.width - 1, r.height - 1, minSide)) continue;
+        areas[i] = cv::contourArea(contours[i]);
+        order.push_back(i);
+    }
+
+    // only the maxCount largest are ordered
+    int keep = std::max(0, std::min((int)order.size(), maxCount));
+    std::partial_sort(order.begin(), order.begin() + keep, order.end(),
+                      [&](int a, int b) { return areas[a] > areas[b]; });
+
+    selected.resize(keep);
+    for (int k = 0; k < keep; ++k) {
+        const auto& c = contours[order[k]];
+        selected[k].clear();
+        selected[k].reserve(c.size());
+        for (const auto& p : c) selected[k].emplace_back(p.x, p.y);
+    }
+}
+
+// A round-join offset of a rectangle by d has straight sides d away from the
+// original ones, so its min area rect is the rectangle grown by 2d per axis.
+bool unclipRect(const cv::Point2f* box, float unClipRatio, cv::Point2f* out) {
+    cv::Mat pts(4, 1, CV_32FC2, const_cast<cv::Point2f*>(box));
+    if (!cv::isContourConvex(pts)) return false;
+
+    double area   = cv::contourArea(pts);
+    double length = cv::arcLength(pts, true);
+    if (area < 1.0 || length <= 0.0) return false;
+
+    cv::RotatedRect rect = cv::minAreaRect(pts);
+    if (std::min(rect.size.width, rect.size.height) < 1.f) return false;
+
+    float distance = static_cast<float>(area * unClipRatio / length);
+    rect.size.width  += 2.f * distance;
+    rect.size.height += 2.f * distance;
+    rect.points(out);
+    return true;
+}
+
 std::vector<float> toCHWFloat(cv::Mat &src, const float *meanVals, const float *stdVals) {
     int H = src.rows;
     int W = src.cols;
@@ -159,6 +626,190 @@ void toCHWFloat(const cv::Mat& src, float* dst, const float* meanVals, const flo
     }
 }
 
+// Crops a text line quad (tl, tr, br, bl) of width x height with the cheapest
+// operation that still matches its geometry:
+//  - axis-aligned boxes: a ROI view at the rounded corner, no copy and no
+//    resampling, off the warp result by less than a pixel
+//  - rotated rectangles: warpAffine, the perspective matrix has no projective part
+//  - other quads: warpPerspective
+cv::Mat cropQuad(const cv::Mat& src, const cv::Point2f* quad, float width, float height, int interp) {
+    const float eps = 1e-3f;
+    cv::Point2f top  = quad[1] - quad[0];
+    cv::Point2f left = quad[3] - quad[0];
+    cv::Point2f bot  = quad[2] - quad[3];
+
+    bool axis = std::fabs(top.y) < eps && std::fabs(left.x) < eps
+             && std::fabs(quad[2].x - quad[1].x) < eps && std::fabs(quad[2].y - quad[3].y) < eps
+             && top.x > 0.f && left.y > 0.f;
+    if (axis) {
+        cv::Rect roi(cvRound(quad[0].x), cvRound(quad[0].y), (int)width, (int)height);
+        if ((roi & cv::Rect(0, 0, src.cols, src.rows)) == roi) {
+            return src(roi);
+        }
+    }
+
+    cv::Point2f dst_pts[4] = {
+        {0.f, 0.f},
+        {width - 1.f, 0.f},
+        {width - 1.f, height - 1.f},
+        {0.f, height - 1.f}
+    };
+    cv::Size dst_size((int)width, (int)height);
+
+    // parallel opposite sides and a right angle
+    float scale = std::max(1.f, std::max(width, height));
+    bool rect = cv::norm(top - bot) < eps * scale
+             && std::fabs(top.dot(left)) < eps * scale * scale;
+
+    cv::Mat dst;
+    if (rect) {
+        cv::Mat affine_mat = cv::getAffineTransform(quad, dst_pts);
+        cv::warpAffine(src, dst, affine_mat, dst_size, interp, cv::BORDER_REPLICATE);
+    } else {
+        cv::Mat perspect_mat = cv::getPerspectiveTransform(quad, dst_pts);
+        cv::warpPerspective(src, dst, perspect_mat, dst_size, interp, cv::BORDER_REPLICATE);
+    }
+    return dst;
+}
+
+// Fused perspective crop + resize + normalize. Every dst pixel is mapped the way
+// cv::resize(INTER_LINEAR) maps it into the (int)quadW x (int)quadH crop, then
+// through the crop -> source homography, and sampled bilinearly with replicated
+// borders. Columns [dstW, padW) are white padding; rotate writes the padded line
+// turned by 180 degrees.
+void warpQuadToCHW(const cv::Mat& src, const cv::Point2f* quad, float quadW, float quadH,
+                   int dstW, int dstH, int padW, float* dst,
+                   const float* meanVals, const float* stdVals, const float scale, bool rotate) {
+    CV_Assert(src.type() == CV_8UC3);
+    cv::Point2f crop_pts[4] = {
+        {0.f, 0.f},
+        {quadW - 1.f, 0.f},
+        {quadW - 1.f, quadH - 1.f},
+        {0.f, quadH - 1.f}
+    };
+    cv::Mat hm = cv::getPerspectiveTransform(crop_pts, quad);
+    const double* h = hm.ptr<double>();
+
+    int crop_w = static_cast<int>(quadW);
+    int crop_h = static_cast<int>(quadH);
+    float fx = static_cast<float>(crop_w) / dstW;
+    float fy = static_cast<float>(crop_h) / dstH;
+    int   cols = src.cols;
+    int   rows = src.rows;
+    int   plane = dstH * padW;
+
+    float mul[3], add[3];
+    for (int c = 0; c < 3; ++c) {
+        mul[c] = scale / stdVals[c];
+        add[c] = -meanVals[c] / stdVals[c];
+    }
+
+    for (int y = 0; y < dstH; ++y) {
+        float cy = std::min(std::max((y + 0.5f) * fy - 0.5f, 0.f), (float)(crop_h - 1));
+        int   oy = rotate ? dstH - 1 - y : y;
+        float* row_r = dst + 0 * plane + oy * padW;
+        float* row_g = dst + 1 * plane + oy * padW;
+        float* row_b = dst + 2 * plane + oy * padW;
+
+        for (int x = 0; x < padW; ++x) {
+            int ox = rotate ? padW - 1 - x : x;
+            float b, g, r;
+            if (x >= dstW) {
+                b = g = r = 255.f;
+            } else {
+                float cx = std::min(std::max((x + 0.5f) * fx - 0.5f, 0.f), (float)(crop_w - 1));
+                double w  = h[6] * cx + h[7] * cy + h[8];
+                double sx = (h[0] * cx + h[1] * cy + h[2]) / w;
+                double sy = (h[3] * cx + h[4] * cy + h[5]) / w;
+
+                int   x0 = static_cast<int>(std::floor(sx));
+                int   y0 = static_cast<int>(std::floor(sy));
+                float ax = static_cast<float>(sx - x0);
+                float ay = static_cast<float>(sy - y0);
+                int   xa = std::min(std::max(x0, 0), cols - 1);
+                int   xb = std::min(std::max(x0 + 1, 0), cols - 1);
+                const uchar* p0 = src.ptr<uchar>(std::min(std::max(y0, 0), rows - 1));
+                const uchar* p1 = src.ptr<uchar>(std::min(std::max(y0 + 1, 0), rows - 1));
+
+                float v[3];
+                for (int c = 0; c < 3; ++c) {
+                    float top = p0[xa * 3 + c] + ax * (p0[xb * 3 + c] - p0[xa * 3 + c]);
+                    float bot = p1[xa * 3 + c] + ax * (p1[xb * 3 + c] - p1[xa * 3 + c]);
+                    v[c] = top + ay * (bot - top);
+                }
+                b = v[0]; g = v[1]; r = v[2];
+            }
+
+            // BGR -> RGB + normalize + CHW
+            row_r[ox] = r * mul[0] + add[0];
+            row_g[ox] = g * mul[1] + add[1];
+            row_b[ox] = b * mul[2] + add[2];
+        }
+    }
+}
+
+// Small gray copy of a line crop, at most thumbHeight rows, for cheap statistics.
+// With quad set src is the page and the quad is sampled, otherwise src is the crop.
+cv::Mat grayThumb(const cv::Mat& src, const cv::Point2f* quad, float width, float height, int thumbHeight) {
+    int th = std::max(1, std::min(thumbHeight, (int) height));
+    int tw = std::max(1, std::min(32 * th, (int) std::lround(width * th / std::max(1.f, height))));
+
+    cv::Mat thumb;
+    if (quad) {
+        cv::Point2f dst_pts[4] = {
+            {0.f, 0.f},
+            {(float) tw, 0.f},
+            {(float) tw, (float) th},
+            {0.f, (float) th}
+        };
+        cv::Mat m = cv::getPerspectiveTransform(quad, dst_pts);
+        cv::warpPerspective(src, thumb, m, cv::Size(tw, th), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    } else {
+        cv::resize(src, thumb, cv::Size(tw, th), 0, 0, cv::INTER_AREA);
+    }
+    if (thumb.channels() == 3) {
+        cv::cvtColor(thumb, thumb, cv::COLOR_BGR2GRAY);
+    } else if (thumb.channels() == 4) {
+        cv::cvtColor(thumb, thumb, cv::COLOR_BGRA2GRAY);
+    }
+    return thumb;
+}
+
+// Gray stddev of a crop and the share of its minority side after an Otsu split,
+// text strokes on a background land well inside (0, 0.5)
+void cropContrastInk(const cv::Mat& gray, float& contrast, float& ink) {
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(gray, mean, stddev);
+    contrast = static_cast<float>(stddev[0]);
+
+    cv::Mat bin;
+    cv::threshold(gray, bin, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+    float fg = static_cast<float>(cv::countNonZero(bin)) / std::max<size_t>(1, gray.total());
+    ink = std::min(fg, 1.f - fg);
+}
+
+// Quad of the crop columns [x0, x1) of a (quadW x quadH) line crop, mapped back
+// through the crop -> source homography so perspective quads stay exact.
+void subQuad(const cv::Point2f* quad, float quadW, float quadH, float x0, float x1, cv::Point2f* out) {
+    cv::Point2f crop_pts[4] = {
+        {0.f, 0.f},
+        {quadW - 1.f, 0.f},
+        {quadW - 1.f, quadH - 1.f},
+        {0.f, quadH - 1.f}
+    };
+    cv::Mat hm = cv::getPerspectiveTransform(crop_pts, quad);
+
+    std::vector<cv::Point2f> seg_pts = {
+        {x0, 0.f},
+        {x1 - 1.f, 0.f},
+        {x1 - 1.f, quadH - 1.f},
+        {x0, quadH - 1.f}
+    };
+    std::vector<cv::Point2f> src_pts;
+    cv::perspectiveTransform(seg_pts, src_pts, hm);
+    for (int i = 0; i < 4; ++i) out[i] = src_pts[i];
+}
+
 vector<unsigned char> loadFile(const string &file) {
     ifstream in(file, ios::in | ios::binary);
     if (!in.is_open())